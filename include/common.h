@@ -28,7 +28,8 @@ enum ins_opcode_t {
 	ALLOC,	// Allocate memory
 	FREE,	// Deallocated a memory block
 	READ,	// Write data to a byte on memory
-	WRITE	// Read data from a byte on memory
+	WRITE,	// Read data from a byte on memory
+	FORK	// Create a copy of the process, both go on after it
 };
 
 /* instructions executed by the CPU */
@@ -39,9 +40,15 @@ struct inst_t {
 	uint32_t arg_2;
 };
 
+struct dinst_t;
+
 struct code_seg_t {
 	struct inst_t * text;
+	struct dinst_t * dtext; // Pre-decoded text executed by the CPU (cpu.h)
 	uint32_t size;
+	void * image;		// Mapped program image holding [text], if any
+	uint64_t image_len;
+	uint32_t refs;		// Processes and cache sharing the segment
 };
 
 struct trans_table_t {
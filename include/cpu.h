@@ -3,11 +3,34 @@
 #define CPU_H
 
 #include "common.h"
+#include <stdatomic.h>
+
+/* Processes loaded or forked that have not finished yet. The CPUs keep
+ * going while any is left, FORK may still give them work */
+extern atomic_int nr_live_procs;
+
+typedef int (*inst_handler_t)(struct pcb_t * proc, const struct dinst_t * ins);
+
+/* Pre-decoded instruction, its handler is resolved once at load time */
+struct dinst_t {
+	inst_handler_t handler;
+	uint32_t arg_0;
+	uint32_t arg_1;
+	uint32_t arg_2;
+	enum ins_opcode_t opcode;
+};
+
+/* Build [code->dtext] from [code->text]. Return 0 on success */
+int decode(struct code_seg_t * code);
 
 /* Execute an instruction of a process. Return 0
  * if the instruction is executed successfully.
  * Otherwise, return 1. */
 int run(struct pcb_t * proc);
 
+/* Execute the CALC instructions starting at the Program Counter, at most
+ * [max] of them. Return the number of executed instructions */
+uint32_t run_calc(struct pcb_t * proc, uint32_t max);
+
 #endif
 
@@ -3,7 +3,41 @@
 
 #include "common.h"
 
+/* Binary program image: this header followed by [size] instructions as
+ * laid out in memory (struct inst_t, host byte order). load() maps large
+ * images and executes the instructions in place */
+#define PROG_MAGIC	"OSPB"
+#define PROG_MAGIC_LEN	4
+#define PROG_VERSION	1
+#define PROG_MAP_MIN	(64 * 1024)	// Smaller images are read, not mapped
+
+struct prog_header_t {
+	char magic[PROG_MAGIC_LEN];
+	uint32_t version;
+	uint32_t priority;
+	uint32_t size;
+};
+
+/* Share the code of the processes loaded from the same path (default),
+ * or read every program again */
+void set_loader_cache(int enable);
+
+/* Load the program at [path], either a text program or an image */
 struct pcb_t * load(const char * path);
 
+/* Create a process running the code of [parent] from where it is, with
+ * its registers and priority. The memory is left to the caller */
+struct pcb_t * clone_pcb(const struct pcb_t * parent);
+
+/* Release [proc] and drop its reference on its code segment */
+void unload(struct pcb_t * proc);
+
+/* Report the program cache and release the cached code segments */
+void finish_loader(void);
+
+/* Write [code] as a program image at [path]. Return 0 on success */
+int save_image(const char * path, uint32_t priority,
+		const struct code_seg_t * code);
+
 #endif
 
@@ -5,18 +5,33 @@
 
 /* CPU Bus definition */
 #define PAGING_CPU_BUS_WIDTH 22 /* 22bit bus - MAX SPACE 4MB */
-#define PAGING_PAGESZ  256      /* 256B or 8-bits PAGE NUMBER */
+/* Page size, chosen with paging_set_pagesz() before any device or mm
+ * is set up, from PAGING_PAGESZ_MIN to PAGING_PAGESZ_MAX. The masks
+ * below are derived from its shift */
+extern int paging_pagesz;
+extern int paging_pgshift;
+#define PAGING_PAGESZ_MIN 256
+#define PAGING_PAGESZ_MAX BIT(16)
+#define PAGING_PAGESZ  paging_pagesz /* 256B or 8-bits PAGE NUMBER by default */
 #define PAGING_MEMRAMSZ BIT(10) /* 1MB */
 #define PAGING_PAGE_ALIGNSZ(sz) (DIV_ROUND_UP(sz,PAGING_PAGESZ)*PAGING_PAGESZ)
 /*
-In this code, `PAGING_PAGE_ALIGNSZ(sz)` is a macro that takes a size `sz` and aligns it to the nearest multiple of `PAGING_PAGESZ`, which is defined to be 256. 
+In this code, `PAGING_PAGE_ALIGNSZ(sz)` is a macro that takes a size `sz` and aligns it to the nearest multiple of `PAGING_PAGESZ`, which is 256 by default. 
 The macro calculates the number of pages required to accommodate `sz` by dividing `sz` by `PAGING_PAGESZ` and rounding up to the nearest integer using `DIV_ROUND_UP()`, a macro defined in `common.h`. It then multiplies the result by `PAGING_PAGESZ` to get the aligned size.
 For example, if `sz` is 500, `PAGING_PAGE_ALIGNSZ(sz)` would return 512, which is the nearest multiple of 256.
 */
 
 #define PAGING_MEMSWPSZ BIT(14) /* 16MB */
 #define PAGING_SWPFPN_OFFSET 5  
-#define PAGING_MAX_PGN  (DIV_ROUND_UP(PAGING_CPU_BUS_WIDTH,PAGING_PAGESZ))
+#define PAGING_MAX_PGN  (DIV_ROUND_UP(BIT(PAGING_CPU_BUS_WIDTH),PAGING_PAGESZ))
+
+/* Two-level page table: the page directory points to page tables of
+ * PAGING_PT_ENTRIES PTEs, allocated when a page they cover is mapped */
+#define PAGING_PT_BITS 8
+#define PAGING_PT_ENTRIES BIT(PAGING_PT_BITS)
+#define PAGING_PGD_ENTRIES DIV_ROUND_UP(PAGING_MAX_PGN, PAGING_PT_ENTRIES)
+#define PAGING_PGD_IDX(pgn) ((pgn) >> PAGING_PT_BITS)
+#define PAGING_PT_IDX(pgn) ((pgn) & (PAGING_PT_ENTRIES - 1))
 
 #define PAGING_SBRK_INIT_SZ PAGING_PAGESZ
 /* PTE BIT */
@@ -24,12 +39,17 @@ For example, if `sz` is 500, `PAGING_PAGE_ALIGNSZ(sz)` would return 512, which i
 #define PAGING_PTE_SWAPPED_MASK BIT(30)
 #define PAGING_PTE_RESERVE_MASK BIT(29)
 #define PAGING_PTE_DIRTY_MASK BIT(28)
+#define PAGING_PTE_REFERENCED_MASK PAGING_PTE_RESERVE_MASK // page accessed, cleared by the replacement policy
 #define PAGING_PTE_EMPTY01_MASK BIT(14)
 #define PAGING_PTE_EMPTY02_MASK BIT(13)
+#define PAGING_PTE_HUGE_MASK BIT(27) // page of a huge mapping, out of the SWPOFF bits
+#define PAGING_PTE_COW_MASK BIT(26) // write protected, frame shared copy-on-write
 
 /* PTE BIT PRESENT */
 #define PAGING_PTE_SET_PRESENT(pte) (pte=pte|PAGING_PTE_PRESENT_MASK)
 #define PAGING_PAGE_PRESENT(pte) (pte&PAGING_PTE_PRESENT_MASK) // if the highst bit in 32 bit is 1 return 1 else 0
+#define PAGING_PAGE_SWAPPED(pte) (pte&PAGING_PTE_SWAPPED_MASK)
+#define PAGING_PAGE_IN_RAM(pte) (PAGING_PAGE_PRESENT(pte) && !PAGING_PAGE_SWAPPED(pte))
 
 /* USRNUM */
 #define PAGING_PTE_USRNUM_LOBIT 15
@@ -43,6 +63,9 @@ For example, if `sz` is 500, `PAGING_PAGE_ALIGNSZ(sz)` would return 512, which i
 /* SWPOFF */
 #define PAGING_PTE_SWPOFF_LOBIT 5
 #define PAGING_PTE_SWPOFF_HIBIT 25
+/* Frames a PTE can address on MEMRAM and on a MEMSWP device */
+#define PAGING_PTE_MAX_FPN BIT(PAGING_PTE_FPN_HIBIT - PAGING_PTE_FPN_LOBIT + 1)
+#define PAGING_PTE_MAX_SWPOFF BIT(PAGING_PTE_SWPOFF_HIBIT - PAGING_PTE_SWPOFF_LOBIT + 1)
 
 
 #define PAGING_PTE_USRNUM_MASK GENMASK(PAGING_PTE_USRNUM_HIBIT,PAGING_PTE_USRNUM_LOBIT) // user num are mask with zero
@@ -52,18 +75,18 @@ For example, if `sz` is 500, `PAGING_PAGE_ALIGNSZ(sz)` would return 512, which i
 
 /* OFFSET */
 #define PAGING_ADDR_OFFST_LOBIT 0
-#define PAGING_ADDR_OFFST_HIBIT (NBITS(PAGING_PAGESZ) - 1)
+#define PAGING_ADDR_OFFST_HIBIT (paging_pgshift - 1)
 
 /* PAGE Num */
-#define PAGING_ADDR_PGN_LOBIT NBITS(PAGING_PAGESZ) //number of bit need to store paging_pagez - 1
+#define PAGING_ADDR_PGN_LOBIT paging_pgshift //number of bit need to store paging_pagez - 1
 #define PAGING_ADDR_PGN_HIBIT (PAGING_CPU_BUS_WIDTH - 1)
 
 /* Frame PHY Num */
-#define PAGING_ADDR_FPN_LOBIT NBITS(PAGING_PAGESZ) //number of bit need to store paging_pagez - 1
+#define PAGING_ADDR_FPN_LOBIT paging_pgshift //number of bit need to store paging_pagez - 1
 #define PAGING_ADDR_FPN_HIBIT (NBITS(PAGING_MEMRAMSZ) - 1)
 
 /* SWAPFPN */
-#define PAGING_SWP_LOBIT NBITS(PAGING_PAGESZ)
+#define PAGING_SWP_LOBIT paging_pgshift
 #define PAGING_SWP_HIBIT (NBITS(PAGING_MEMSWPSZ) - 1)
 #define PAGING_SWP(pte) ((pte&PAGING_SWP_MASK) >> PAGING_SWPFPN_OFFSET) // get fram of swap from adress
 
@@ -74,6 +97,12 @@ For example, if `sz` is 500, `PAGING_PAGE_ALIGNSZ(sz)` would return 512, which i
 #define SETVAL(v,value,mask,offst) (v=(v&~mask)|((value<<offst)&mask))
 #define GETVAL(v,mask,offst) ((v&mask)>>offst)
 
+/* Extract the FPN of an in RAM PTE, the swap offset and type of a
+ * swapped one */
+#define PAGING_PTE_FPN(pte) GETVAL(pte,PAGING_PTE_FPN_MASK,PAGING_PTE_FPN_LOBIT)
+#define PAGING_PTE_SWP(pte) GETVAL(pte,PAGING_PTE_SWPOFF_MASK,PAGING_PTE_SWPOFF_LOBIT)
+#define PAGING_PTE_SWPTYP(pte) GETVAL(pte,PAGING_PTE_SWPTYP_MASK,PAGING_PTE_SWPTYP_LOBIT)
+
 /* Masks */
 #define PAGING_OFFST_MASK  GENMASK(PAGING_ADDR_OFFST_HIBIT,PAGING_ADDR_OFFST_LOBIT)
 #define PAGING_PGN_MASK  GENMASK(PAGING_ADDR_PGN_HIBIT,PAGING_ADDR_PGN_LOBIT) // mask for virtual memory
@@ -100,14 +129,21 @@ For example, if `sz` is 500, `PAGING_PAGE_ALIGNSZ(sz)` would return 512, which i
 struct vm_rg_struct * init_vm_rg(int rg_start, int rg_endi);
 int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct* rgnode);
 int enlist_pgn_node(struct pgn_t **pgnlist, int pgn);
-int vmap_page_range(struct pcb_t *caller, int addr, int pgnum, 
-                    struct framephy_struct **frames, struct vm_rg_struct *ret_rg);
-int vm_map_ram(struct pcb_t *caller, int astart, int send, int mapstart, int incpgnum, struct vm_rg_struct *ret_rg);
-int alloc_pages_range(struct pcb_t *caller, int incpgnum, struct framephy_struct **frm_lst);
 int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
                 struct memphy_struct *mpdst, int dstfpn) ;
 int pte_set_fpn(uint32_t *pte, int fpn);
 int pte_set_swap(uint32_t *pte, int swptyp, int swpoff);
+uint32_t *pte_get(struct mm_struct *mm, int pgn);
+uint32_t *pte_alloc(struct mm_struct *mm, int pgn);
+int mm_pgtable_bytes(struct mm_struct *mm);
+int paging_set_pagesz(int pagesz);
+/* Huge pages: runs of paging_huge_pgnum pages on contiguous frames, one
+ * TLB entry each, kept in MEMRAM. 0 when disabled */
+#define PAGING_HUGE_DEFAULT_PGNUM 16
+extern int paging_huge_pgnum;
+int paging_set_huge(int pgnum);
+int vmap_huge_page(struct pcb_t *caller, int addr);
+void paging_report(void);
 int init_pte(uint32_t *pte,
              int pre,    // present
              int fpn,    // FPN
@@ -120,6 +156,8 @@ int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+void free_mm(struct mm_struct *mm);
+int fork_mm(struct pcb_t *child, struct pcb_t *parent);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -140,15 +178,87 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz);
 int find_victim_page(struct mm_struct* mm, int *pgn);
+
+/* Page replacement policies */
+enum pgrepl_policy_t {
+  PGREPL_FIFO,  /* Oldest resident page */
+  PGREPL_CLOCK, /* Second chance on the referenced bit */
+  PGREPL_LRU,   /* Aging counters fed by the referenced bit */
+  PGREPL_OPT    /* Farthest next use in a recorded trace */
+};
+int pgrepl_set_policy(enum pgrepl_policy_t policy, const char *trace);
+int pgrepl_set_trace(const char *path);
+int pgrepl_init_mm(struct mm_struct *mm, struct pcb_t *caller);
+int pgrepl_add(struct mm_struct *mm, int pgn);
+void pgrepl_access(struct mm_struct *mm, struct pcb_t *caller, int pgn);
+void pgrepl_report(void);
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 
+/* Global frame reclaim */
+void reclaim_lock(void);
+void reclaim_unlock(void);
+void mm_lock(struct mm_struct *mm);
+void mm_unlock(struct mm_struct *mm);
+void reclaim_register_mm(struct mm_struct *mm, struct pcb_t *caller);
+void reclaim_unregister_mm(struct mm_struct *mm);
+int reclaim_get_frame(struct pcb_t *caller, int *fpn);
+/* Placement of evicted pages over the swap devices */
+enum swap_place_t {
+  SWAP_PLACE_STRIPE, /* Round-robin over the devices */
+  SWAP_PLACE_FREE,   /* Device with the most free frames */
+  SWAP_PLACE_TIER    /* Fastest device with a free frame */
+};
+int reclaim_set_swap(int swptyp, struct memphy_struct *mp);
+int reclaim_set_swap_place(enum swap_place_t place);
+int reclaim_swap_in(struct pcb_t *caller, uint32_t pte, int fpn);
+void reclaim_fault(uint64_t in_cost, uint64_t out_cost);
+int kswapd_set_watermarks(int low, int high);
+int kswapd_enabled(void);
+int kswapd_balance(struct memphy_struct *mram);
+void reclaim_get_stats(unsigned long *faults, unsigned long *stolen);
+void reclaim_report(void);
+int free_pcb_memph(struct pcb_t *caller);
+int reclaim_fork_pages(struct pcb_t *parent, struct pcb_t *child);
+int reclaim_cow_break(struct pcb_t *caller, int pgn, int *fpn);
+
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *fpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn);
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int nr, int *fpn);
 int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data);
+int MEMPHY_cp_frame(struct memphy_struct *mpsrc, int srcfpn,
+                    struct memphy_struct *mpdst, int dstfpn, int pagesz);
+int MEMPHY_zero(struct memphy_struct *mp, int addr, int len);
+#define MEMPHY_COST_UNIT 1000 /* Costs are in thousandths of a slot */
+int MEMPHY_set_timing(struct memphy_struct *mp, int lat, int seek, int xfer);
+uint64_t MEMPHY_cost(struct memphy_struct *mp, int len);
+uint64_t MEMPHY_charged(void);
+uint32_t MEMPHY_take_stall(void);
+void MEMPHY_report(struct memphy_struct *mp, const char *name);
+int MEMPHY_set_owner(struct memphy_struct *mp, int fpn,
+                     struct mm_struct *owner, int pgn);
 int MEMPHY_dump(struct memphy_struct * mp);
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg);
+int init_memphy_mapped(struct memphy_struct *mp, int max_size, int randomflg,
+                       const char *path);
+void free_memphy(struct memphy_struct *mp);
+/* TLB prototypes */
+#define TLB_DEFAULT_ENTRIES 64
+#define TLB_DEFAULT_WAYS 4
+int tlb_set_geometry(int entries, int ways);
+int tlb_attach_cpu(void);
+void tlb_detach_cpu(void);
+int tlb_lookup(uint32_t *pte, int *fpn);
+void tlb_insert(uint32_t *pte, int fpn);
+void tlb_invalidate(uint32_t *pte);
+void tlb_flush(void);
+void tlb_switch_mm(struct mm_struct *mm);
+void tlb_shootdown(struct mm_struct *mm);
+void tlb_get_stats(unsigned long *hits, unsigned long *misses,
+                   unsigned long *flushes, unsigned long *invals);
+void tlb_report(void);
+
 /* DEBUG */
 int print_list_fp(struct framephy_struct *fp);
 int print_list_rg(struct vm_rg_struct *rg);
@@ -1,6 +1,9 @@
 #ifndef OSMM_H
 #define OSMM_H
 
+#include <sys/types.h> /* pthread_mutex_t */
+#include <stdatomic.h>
+
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
 #define PAGING_MAX_SYMTBL_SZ 30
@@ -42,19 +45,45 @@ struct vm_area_struct {
    struct vm_area_struct *vm_next;
 };
 
+/*
+ * Resident pages of an mm as seen by the page replacement policy
+ */
+struct pgrepl_struct {
+   int *pgn;       // ring of the resident pages, oldest first
+   int cap;
+   int head;
+   atomic_int count; // read without the lock by the reclaimer
+   uint8_t *age;   // LRU aging counter of each page, allocated on demand
+
+   /* OPT oracle: reference string of the process in a recorded trace */
+   const int *opt_ref;
+   long opt_len;
+   long opt_pos;   // next reference
+};
+
 /* 
  * Memory management struct
  */
 struct mm_struct {
-   uint32_t *pgd; // manage the virtual memory it map virtual to disk. pgd[index] = value. index is page and value is adress (offset+frame)
+   uint32_t **pgd; // page directory, pgd[PAGING_PGD_IDX(pgn)][PAGING_PT_IDX(pgn)] is the PTE of page pgn, use pte_get()
+   int nr_pt;      // page tables allocated
 
    struct vm_area_struct *mmap;
 
    /* Currently we support a fixed number of symbol */
    struct vm_rg_struct symrgtbl[PAGING_MAX_SYMTBL_SZ];
 
-   /* list of free page */
-   struct pgn_t *fifo_pgn; // manage the order of pgn
+   /* Page table and resident pages, victims are chosen among them, both
+    * under [lock] */
+   pthread_mutex_t lock;
+   struct pgrepl_struct pgrepl;
+   int rss_peak;
+   int nr_huge;    // pages of huge mappings, pinned in MEMRAM
+
+   /* Registry of the live mm, the reclaimer takes frames from any of them */
+   int pid;
+   struct mm_struct *mm_prev, *mm_next;
+   atomic_uint tlb_gen; // bumped when another CPU changed a translation
 };
 
 /*
@@ -62,6 +91,10 @@ struct mm_struct {
  */
 struct framephy_struct {
    int fpn;
+   int pgn; // page mapped in the frame, -1 while it is not mapped yet
+   int swptyp; // swap device and frame holding a copy of the page,
+   int swpoff; // swpoff is -1 if there is none
+   atomic_int refs; // PTEs mapping the frame, above 1 while shared copy-on-write
    struct framephy_struct *fp_next;
 
    /* Resereed for tracking allocated framed by virtual memory*/
@@ -72,13 +105,26 @@ struct memphy_struct {
    /* Basic field of data and size */
    BYTE *storage; // BYTE is char storage maybe a string it is a array in size is maxsz
    int maxsz; // at begin it have int(maxsz/PAGINGSZ) frame
+   int mapped; // storage is mmap()ed rather than malloc()ed
    
    /* Sequential device fields */ 
    int rdmflg; // defines the memory access is randomly or serially access
-   int cursor;
+   atomic_int cursor;
+
+   /* Timing model, costs in thousandths of a slot */
+   int timed;     // any cost set
+   int lat_cost;  // every access
+   int seek_cost; // per KB the cursor travels
+   int xfer_cost; // per KB transferred
+   atomic_ulong busy; // time spent on accesses
+   atomic_ulong nr_access, nr_bytes, seek_bytes;
 
    /* Management structure */
-   struct framephy_struct *free_fp_list; //link list store head
+   _Atomic uint64_t *fp_bitmap; // one bit per frame, set while the frame is in use
+   int numfp;
+   atomic_int nr_free;
+   atomic_int fp_hint; // where the search for a free frame starts
+   struct framephy_struct *fp_tbl; // ownership table, one entry per frame
    struct framephy_struct *used_fp_list; // link list store head
 };
 
@@ -4,13 +4,19 @@
 
 #include "common.h"
 
-#define MAX_QUEUE_SIZE 10
+/* Initial capacity of a queue, the queue doubles whenever it is full */
+#define QUEUE_INIT_SIZE 16
 
+/* FIFO of processes kept in a growable circular buffer */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
-	int size;
+	struct pcb_t ** proc;
+	int head;	// Index of the oldest process
+	int size;	// Number of queued processes
+	int capacity;	// Always a power of two (or 0 before first use)
 };
 
+void init_queue(struct queue_t * q);
+
 void enqueue(struct queue_t * q, struct pcb_t * proc);
 
 struct pcb_t * dequeue(struct queue_t * q);
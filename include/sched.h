@@ -1,5 +1,5 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
 
@@ -7,20 +7,46 @@
 #define MLQ_SCHED
 #endif
 
+#ifndef MAX_PRIO
 #define MAX_PRIO 139
+#endif
+
+/* Policies used to pick the next level of the MLQ ready queue */
+enum sched_policy_t {
+	SCHED_POLICY_PRIO,	// Always serve the highest priority level
+	SCHED_POLICY_RR		// Walk the levels round-robin (legacy)
+};
+
+/* Layout of the MLQ run queues */
+enum sched_rq_mode_t {
+	SCHED_RQ_PERCPU,	// One run queue per CPU with work stealing
+	SCHED_RQ_GLOBAL		// A single run queue shared by all CPUs
+};
+
+/* Select the MLQ policy, must be called before the CPUs start.
+ * Return 0 on success, -1 if MLQ scheduling is not compiled in */
+int set_sched_policy(enum sched_policy_t policy);
+
+/* Select the run queue layout, must be called before init_scheduler().
+ * Return 0 on success, -1 if MLQ scheduling is not compiled in */
+int set_sched_rq_mode(enum sched_rq_mode_t mode);
 
 int queue_empty(void);
 
-void init_scheduler(void);
+void init_scheduler(int ncpus);
+
+/* Print the dispatch counters and release the run queues */
 void finish_scheduler(void);
 
-/* Get the next process from ready queue */
-struct pcb_t * get_proc(void);
+/* Get the next process for CPU [cpu], stealing from a sibling when its
+ * own run queue is empty. [timeslot] receives the quantum granted to
+ * the returned process */
+struct pcb_t * get_proc(int cpu, int * timeslot);
 
-/* Put a process back to run queue */
-void put_proc(struct pcb_t * proc);
+/* Put a process preempted on CPU [cpu] back to that CPU's run queue */
+void put_proc(int cpu, struct pcb_t * proc);
 
-/* Add a new process to ready queue */
+/* Add a new process to ready queue, run queues are filled round-robin */
 void add_proc(struct pcb_t * proc);
 
 #endif
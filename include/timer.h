@@ -1,18 +1,41 @@
+
 #ifndef TIMER_H
 #define TIMER_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 
+/* Engines used to synchronize devices with the timer at every slot */
+enum timer_engine_t {
+	TIMER_ENGINE_CONDVAR,	// Per-device mutex/condvar handshake (default)
+	TIMER_ENGINE_BARRIER	// Single sense-reversing atomic barrier
+};
+
+/* Wake time of a device idling until some other device makes progress */
+#define TIMER_NEVER	UINT64_MAX
+
 struct timer_id_t {
 	int done;
 	int fsh;
+	uint64_t idle_until;	// 0 if busy, else time of the next own work
+	uint64_t resume_at;	// Slot at which the device attends again
+	int sense;	// Local sense of the device (barrier engine only)
+	atomic_int parked;	// Skipping slots (barrier engine only)
 	pthread_cond_t event_cond;
 	pthread_mutex_t event_lock;
 	pthread_cond_t timer_cond;
 	pthread_mutex_t timer_lock;
 };
 
+/* Select the engine driving the time slots. Must be called before
+ * start_timer(). Return 0 on success, -1 if the timer already started */
+int set_timer_engine(enum timer_engine_t engine);
+
+/* Enable skipping the slots in which every device idles. Must be
+ * called before start_timer() */
+int set_timer_fast_forward(int enable);
+
 void start_timer();
 
 void stop_timer();
@@ -23,6 +46,16 @@ void detach_event(struct timer_id_t * event);
 
 void next_slot(struct timer_id_t* timer_id);
 
+/* Tell the timer the device is done with the current slot and the
+ * [n] - 1 following ones, and wait for the start of slot now + [n]. The
+ * timer does not wait for the device in between */
+void next_slots(struct timer_id_t* timer_id, uint32_t n);
+
+/* Same as next_slot() for a device which has nothing to do before
+ * [wake_time] (TIMER_NEVER if it only waits for other devices) */
+void idle_slot(struct timer_id_t* timer_id, uint64_t wake_time);
+
 uint64_t current_time();
 
 #endif
+
@@ -0,0 +1,664 @@
+/*
+ * Micro benchmarks of the simulator building blocks
+ * Usage: bench [timer|queue|interp|load|frames|swap|tlb|faults] [args]
+ *
+ * The simulator modules keep printing their trace on stdout, so stdout
+ * is muted while benchmarking and the report goes to the original one.
+ */
+
+#include "timer.h"
+#include "queue.h"
+#include "cpu.h"
+#include "loader.h"
+#include "mm.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static FILE * report;
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Timer: slots per second for a given number of simulated CPUs
+ */
+static int bench_slots;
+
+static void * bench_timer_dev(void * args) {
+	struct timer_id_t * timer_id = (struct timer_id_t *)args;
+	int s;
+	for (s = 0; s < bench_slots; s++) {
+		next_slot(timer_id);
+	}
+	detach_event(timer_id);
+	return NULL;
+}
+
+static double bench_timer_run(enum timer_engine_t engine, int ncpus) {
+	pthread_t * dev = malloc(ncpus * sizeof(pthread_t));
+	struct timer_id_t ** ids = malloc(ncpus * sizeof(struct timer_id_t *));
+	int i;
+
+	set_timer_engine(engine);
+	for (i = 0; i < ncpus; i++) {
+		ids[i] = attach_event();
+	}
+	double start = now_sec();
+	start_timer();
+	for (i = 0; i < ncpus; i++) {
+		pthread_create(&dev[i], NULL, bench_timer_dev, ids[i]);
+	}
+	for (i = 0; i < ncpus; i++) {
+		pthread_join(dev[i], NULL);
+	}
+	stop_timer();
+	double elapsed = now_sec() - start;
+
+	free(ids);
+	free(dev);
+	return bench_slots / elapsed;
+}
+
+static void bench_timer(int argc, char * argv[]) {
+	int ncpus;
+	bench_slots = (argc > 0) ? atoi(argv[0]) : 2000;
+	fprintf(report, "timer: %d slots per run\n", bench_slots);
+	fprintf(report, "%6s %16s %16s %8s\n",
+		"cpus", "condvar slot/s", "barrier slot/s", "speedup");
+	for (ncpus = 1; ncpus <= 128; ncpus *= 2) {
+		double cv = bench_timer_run(TIMER_ENGINE_CONDVAR, ncpus);
+		double br = bench_timer_run(TIMER_ENGINE_BARRIER, ncpus);
+		fprintf(report, "%6d %16.0f %16.0f %7.2fx\n",
+			ncpus, cv, br, br / cv);
+		fflush(report);
+	}
+}
+
+/*
+ * Queue: ring buffer queue_t against the former array shift queue,
+ * measured as dequeue + enqueue pairs on a queue holding [depth] items
+ */
+struct shift_queue_t {
+	struct pcb_t ** proc;
+	int size;
+};
+
+static void shift_enqueue(struct shift_queue_t * q, struct pcb_t * proc) {
+	q->proc[q->size++] = proc;
+}
+
+static struct pcb_t * shift_dequeue(struct shift_queue_t * q) {
+	struct pcb_t * result = q->proc[0];
+	int i;
+	for (i = 0; i < q->size - 1; i++) q->proc[i] = q->proc[i + 1];
+	q->size--;
+	return result;
+}
+
+static double bench_queue_shift(struct pcb_t * procs, int depth, long ops) {
+	struct shift_queue_t q;
+	long i;
+
+	q.proc = malloc(depth * sizeof(struct pcb_t *));
+	q.size = 0;
+	for (i = 0; i < depth; i++) shift_enqueue(&q, &procs[i]);
+	double start = now_sec();
+	for (i = 0; i < ops; i++) shift_enqueue(&q, shift_dequeue(&q));
+	double elapsed = now_sec() - start;
+	free(q.proc);
+	return ops / elapsed;
+}
+
+static double bench_queue_ring(struct pcb_t * procs, int depth, long ops) {
+	struct queue_t q;
+	long i;
+
+	init_queue(&q);
+	for (i = 0; i < depth; i++) enqueue(&q, &procs[i]);
+	double start = now_sec();
+	for (i = 0; i < ops; i++) enqueue(&q, dequeue(&q));
+	double elapsed = now_sec() - start;
+	free(q.proc);
+	return ops / elapsed;
+}
+
+static void bench_queue(int argc, char * argv[]) {
+	long ops = (argc > 0) ? atol(argv[0]) : 200000;
+	int depth;
+	fprintf(report, "queue: %ld dequeue+enqueue per run\n", ops);
+	fprintf(report, "%6s %16s %16s %8s\n",
+		"depth", "shift op/s", "ring op/s", "speedup");
+	for (depth = 1; depth <= 4096; depth *= 4) {
+		struct pcb_t * procs = calloc(depth, sizeof(struct pcb_t));
+		double sh = bench_queue_shift(procs, depth, ops);
+		double rg = bench_queue_ring(procs, depth, ops);
+		fprintf(report, "%6d %16.0f %16.0f %7.2fx\n",
+			depth, sh, rg, rg / sh);
+		fflush(report);
+		free(procs);
+	}
+}
+
+/*
+ * Interpreter: instructions/second of the former switch-based run()
+ * against the pre-decoded handler table, over the input/proc programs
+ * run again and again up to millions of instructions. Memory instructions are
+ * executed by a stand-in in both interpreters, their real cost is the
+ * paging subsystem's and would hide the dispatch cost. The two are within
+ * noise of each other, the table is kept for binding and validating the
+ * opcodes once at load time, not for speed
+ */
+int calc(struct pcb_t * proc);
+
+static volatile uint32_t bench_mem_sink;
+
+static int bench_mem_op(struct pcb_t * proc, uint32_t a, uint32_t b, uint32_t c) {
+	bench_mem_sink += a + b + c;
+	return 0;
+}
+
+static int bench_mem_handler(struct pcb_t * proc, const struct dinst_t * ins) {
+	bench_mem_sink += ins->arg_0 + ins->arg_1 + ins->arg_2;
+	return 0;
+}
+
+__attribute__((noinline))
+static int switch_run(struct pcb_t * proc) {
+	if (proc->pc >= proc->code->size) {
+		return 1;
+	}
+	struct inst_t ins = proc->code->text[proc->pc];
+	proc->pc++;
+	int stat = 1;
+	switch (ins.opcode) {
+	case CALC:
+		stat = calc(proc);
+		break;
+	case ALLOC:
+	case FREE:
+	case READ:
+	case WRITE:
+		stat = bench_mem_op(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+		break;
+	default:
+		stat = 1;
+	}
+	return stat;
+}
+
+__attribute__((noinline)) static double bench_interp_run(struct pcb_t * proc,
+		int (*step)(struct pcb_t *), long target) {
+	long done = 0;
+	double start = now_sec();
+	while (done < target) {
+		proc->pc = 0;
+		while (proc->pc < proc->code->size) {
+			step(proc);
+		}
+		done += proc->code->size;
+	}
+	return done / (now_sec() - start);
+}
+
+static int filter_proc(const struct dirent * d) {
+	return d->d_name[0] != '.';
+}
+
+static void bench_interp(int argc, char * argv[]) {
+	long target = (argc > 0) ? atol(argv[0]) : 4000000;
+	struct dirent ** names;
+	int n, i;
+	uint32_t k;
+
+	n = scandir("input/proc", &names, filter_proc, alphasort);
+	if (n < 0) {
+		fprintf(report, "interp: cannot list input/proc\n");
+		return;
+	}
+	fprintf(report, "interp: programs rerun up to %ld instructions\n",
+		target);
+	fprintf(report, "%8s %10s %16s %16s %8s\n",
+		"program", "insts", "switch inst/s", "decoded inst/s", "ratio");
+	for (i = 0; i < n; i++) {
+		char path[300];
+		snprintf(path, sizeof(path), "input/proc/%s", names[i]->d_name);
+		struct pcb_t * proc = load(path);
+		struct code_seg_t * code = proc->code;
+
+		if (code->size == 0) {
+			free(names[i]);
+			continue;
+		}
+		for (k = 0; k < code->size; k++) {
+			if (code->dtext[k].opcode != CALC) {
+				code->dtext[k].handler = bench_mem_handler;
+			}
+		}
+
+		double sw = bench_interp_run(proc, switch_run, target);
+		double dc = bench_interp_run(proc, run, target);
+		fprintf(report, "%8s %10u %16.0f %16.0f %7.2fx\n",
+			names[i]->d_name, code->size, sw, dc, dc / sw);
+		fflush(report);
+
+		free(names[i]);
+	}
+	free(names);
+}
+
+/*
+ * Loader: programs loaded per second from the text format and from the
+ * program image written by save_image(), both read again every time,
+ * and from the program cache, for every input/proc program and for a
+ * generated program large enough for its image to be mapped
+ */
+#define BENCH_BIG_PROG	200000
+
+static double bench_load_run(const char * path, long count, int cache) {
+	long i;
+	set_loader_cache(cache);
+	if (cache) {
+		unload(load(path));	// Time the hits only
+	}
+	double start = now_sec();
+	for (i = 0; i < count; i++) {
+		unload(load(path));
+	}
+	double rate = count / (now_sec() - start);
+	finish_loader();
+	return rate;
+}
+
+static void bench_load_row(const char * name, const char * path,
+		const char * image, long count) {
+	struct pcb_t * proc = load(path);
+	if (save_image(image, proc->priority, proc->code)) {
+		fprintf(report, "load: cannot write %s\n", image);
+		unload(proc);
+		return;
+	}
+	double txt = bench_load_run(path, count, 0);
+	double img = bench_load_run(image, count, 0);
+	double hit = bench_load_run(path, count, 1);
+	fprintf(report, "%8s %10u %14.0f %14.0f %14.0f %7.2fx %7.2fx\n",
+		name, proc->code->size, txt, img, hit, img / txt, hit / txt);
+	fflush(report);
+	unload(proc);
+}
+
+static void bench_load(int argc, char * argv[]) {
+	long count = (argc > 0) ? atol(argv[0]) : 20000;
+	struct dirent ** names;
+	char image[] = "/tmp/bench-imageXXXXXX";
+	char text[] = "/tmp/bench-textXXXXXX";
+	int n, i, fd, fd2;
+
+	n = scandir("input/proc", &names, filter_proc, alphasort);
+	fd = mkstemp(image);
+	fd2 = mkstemp(text);
+	if (n < 0 || fd < 0 || fd2 < 0) {
+		fprintf(report, "load: cannot prepare the programs\n");
+		return;
+	}
+	close(fd);
+	close(fd2);
+	fprintf(report, "load: %ld loads per program\n", count);
+	fprintf(report, "%8s %10s %14s %14s %14s %8s %8s\n", "program",
+		"insts", "text loads/s", "image loads/s", "cached loads/s",
+		"image", "cached");
+	for (i = 0; i < n; i++) {
+		char path[300];
+		snprintf(path, sizeof(path), "input/proc/%s", names[i]->d_name);
+		bench_load_row(names[i]->d_name, path, image, count);
+		free(names[i]);
+	}
+	FILE * big = fopen(text, "w");
+	if (big != NULL) {
+		static const char * ops[] = {
+			"calc", "alloc 300 0", "write 100 0 20", "read 0 20 1",
+			"free 0"
+		};
+		fprintf(big, "1 %d\n", BENCH_BIG_PROG);
+		for (i = 0; i < BENCH_BIG_PROG; i++) {
+			fprintf(big, "%s\n", ops[i % 5]);
+		}
+		fclose(big);
+		bench_load_row("big", text, image, count / 1000 + 1);
+	}
+	free(names);
+	unlink(image);
+	unlink(text);
+}
+
+/*
+ * Frames: time to set up a MEMPHY device of each size and throughput of
+ * taking every frame and giving them all back, in a scattered order
+ */
+static void bench_frames(int argc, char * argv[]) {
+	static const int sizes[] = { 1 << 20, 16 << 20, 64 << 20, 256 << 20 };
+	int rounds = (argc > 0) ? atoi(argv[0]) : 4;
+	unsigned int s;
+
+	fprintf(report, "frames: %d alloc/free rounds, %d-byte pages\n",
+		rounds, PAGING_PAGESZ);
+	fprintf(report, "%10s %10s %12s %16s\n",
+		"device", "frames", "init ms", "get+put/s");
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		struct memphy_struct mp;
+		double start = now_sec();
+		init_memphy(&mp, sizes[s], 1);
+		double init = now_sec() - start;
+		int * fpn = malloc(mp.numfp * sizeof(int));
+		int r, i, n = 0;
+
+		start = now_sec();
+		for (r = 0; r < rounds; r++) {
+			for (n = 0; MEMPHY_get_freefp(&mp, &fpn[n]) == 0; n++)
+				;
+			/* Every other frame first, then the rest */
+			for (i = 0; i < n; i += 2) {
+				MEMPHY_put_freefp(&mp, fpn[i]);
+			}
+			for (i = 1; i < n; i += 2) {
+				MEMPHY_put_freefp(&mp, fpn[i]);
+			}
+		}
+		double ops = 2.0 * n * rounds / (now_sec() - start);
+		fprintf(report, "%9dM %10d %12.3f %16.0f\n",
+			sizes[s] >> 20, n, init * 1e3, ops);
+		fflush(report);
+		free(fpn);
+		free_memphy(&mp);
+	}
+}
+
+/*
+ * Swap: pages/second moved between a 1MB RAM and a 16MB swap by the
+ * former byte-per-call __swap_cp_page() and by the frame copy, in both
+ * directions over scattered frames. The sequential swap only has the
+ * frame copy, the byte path cannot read from it
+ */
+static void swap_cp_bytes(struct memphy_struct * mpsrc, int srcfpn,
+		struct memphy_struct * mpdst, int dstfpn) {
+	int cellidx;
+	for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++) {
+		BYTE data;
+		MEMPHY_read(mpsrc, srcfpn * PAGING_PAGESZ + cellidx, &data);
+		MEMPHY_write(mpdst, dstfpn * PAGING_PAGESZ + cellidx, data);
+	}
+}
+
+static double bench_swap_run(struct memphy_struct * src,
+		struct memphy_struct * dst, long pages, int bytes) {
+	int nsrc = src->maxsz / PAGING_PAGESZ;
+	int ndst = dst->maxsz / PAGING_PAGESZ;
+	long i;
+	double start = now_sec();
+	for (i = 0; i < pages; i++) {
+		int s = (i * 7919) % nsrc, d = (i * 104729) % ndst;
+		if (bytes) {
+			swap_cp_bytes(src, s, dst, d);
+		}else{
+			__swap_cp_page(src, s, dst, d);
+		}
+	}
+	return pages / (now_sec() - start);
+}
+
+static void bench_swap(int argc, char * argv[]) {
+	long pages = (argc > 0) ? atol(argv[0]) : 200000;
+	struct memphy_struct ram, swp, seq;
+
+	init_memphy(&ram, 1 << 20, 1);
+	init_memphy(&swp, 16 << 20, 1);
+	init_memphy(&seq, 16 << 20, 0);
+	memset(ram.storage, 0x5a, ram.maxsz);
+
+	fprintf(report, "swap: %ld pages of %d bytes\n", pages, PAGING_PAGESZ);
+	fprintf(report, "%14s %14s %14s %8s\n",
+		"direction", "bytes pages/s", "frame pages/s", "speedup");
+	double b = bench_swap_run(&ram, &swp, pages, 1);
+	double f = bench_swap_run(&ram, &swp, pages, 0);
+	fprintf(report, "%14s %14.0f %14.0f %7.2fx\n", "ram->swap", b, f, f / b);
+	b = bench_swap_run(&swp, &ram, pages, 1);
+	f = bench_swap_run(&swp, &ram, pages, 0);
+	fprintf(report, "%14s %14.0f %14.0f %7.2fx\n", "swap->ram", b, f, f / b);
+	f = bench_swap_run(&ram, &seq, pages, 0);
+	fprintf(report, "%14s %14s %14.0f %8s\n", "ram->seqswap", "-", f, "-");
+	fflush(report);
+
+	free_memphy(&ram);
+	free_memphy(&swp);
+	free_memphy(&seq);
+}
+
+/*
+ * TLB: translations/second of pg_getval() over working sets of pages of
+ * one process, with the TLB off and at a few geometries, with hit rates
+ */
+int pg_getval(struct mm_struct * mm, int addr, BYTE * data,
+	struct pcb_t * caller);
+
+static void bench_tlb(int argc, char * argv[]) {
+	static const int sets[] = { 8, 64, 512 };
+	static const int geo[][2] = { { 0, 1 }, { 16, 1 }, { 64, 4 }, { 256, 8 } };
+	long accesses = (argc > 0) ? atol(argv[0]) : 4000000;
+	struct memphy_struct ram, swp;
+	struct pcb_t proc;
+	unsigned int w, g;
+	int addr;
+
+	memset(&proc, 0, sizeof(proc));
+	init_memphy(&ram, 1 << 20, 1);
+	init_memphy(&swp, 16 << 20, 1);
+	proc.mram = &ram;
+	proc.mswp = NULL;
+	proc.active_mswp = &swp;
+	proc.mm = calloc(1, sizeof(struct mm_struct));
+	init_mm(proc.mm, &proc);
+	__alloc(&proc, 0, 0, 512 * PAGING_PAGESZ, &addr);
+
+	fprintf(report, "tlb: %ld translations per working set\n", accesses);
+	fprintf(report, "%8s %10s %14s %8s\n",
+		"pages", "tlb", "translations/s", "hit");
+	for (w = 0; w < sizeof(sets) / sizeof(sets[0]); w++) {
+		for (g = 0; g < sizeof(geo) / sizeof(geo[0]); g++) {
+			unsigned long seed = 1, hits0, misses0, hits, misses;
+			char name[16];
+			long i;
+			BYTE data;
+
+			tlb_get_stats(&hits0, &misses0, NULL, NULL);
+			tlb_set_geometry(geo[g][0], geo[g][1]);
+			tlb_attach_cpu();
+			double start = now_sec();
+			for (i = 0; i < accesses; i++) {
+				seed = seed * 6364136223846793005UL + 1;
+				int pg = (seed >> 33) % sets[w];
+				pg_getval(proc.mm, addr + pg * PAGING_PAGESZ +
+					(i & (PAGING_PAGESZ - 1)), &data, &proc);
+			}
+			double rate = accesses / (now_sec() - start);
+			tlb_detach_cpu();
+			tlb_get_stats(&hits, &misses, NULL, NULL);
+			snprintf(name, sizeof(name), geo[g][0] ? "%dx%d" : "off",
+				geo[g][0], geo[g][1]);
+			fprintf(report, "%8d %10s %14.0f %7.1f%%\n", sets[w], name,
+				rate, (hits + misses > hits0 + misses0) ?
+				100.0 * (hits - hits0) /
+				(hits + misses - hits0 - misses0) : 0.0);
+			fflush(report);
+		}
+	}
+	tlb_set_geometry(TLB_DEFAULT_ENTRIES, TLB_DEFAULT_WAYS);
+	free_pcb_memph(&proc);
+	free_mm(proc.mm);
+	free(proc.mm);
+	free_memphy(&ram);
+	free_memphy(&swp);
+}
+
+/*
+ * Faults: page accesses/second of CPU threads each running a process
+ * over 64 pages, sharing a MEMRAM that holds half of them, so that they
+ * fault and evict pages of each other concurrently. Every page holds a
+ * value of its own, a different value read back is counted as an error
+ */
+#define FAULT_PAGES	64
+#define FAULT_CHUNK	8	/* Pages per allocation */
+
+int pg_setval(struct mm_struct * mm, int addr, BYTE value,
+	struct pcb_t * caller);
+
+struct fault_cpu_t {
+	struct pcb_t proc;
+	pthread_barrier_t * start;
+	long accesses;
+	long errors;
+	double sec;
+};
+
+static void * fault_cpu(void * args) {
+	struct fault_cpu_t * fc = (struct fault_cpu_t *)args;
+	struct pcb_t * proc = &fc->proc;
+	unsigned long seed = proc->pid + 1;
+	int addr[FAULT_PAGES], pg;
+	long i;
+	BYTE data;
+
+	tlb_attach_cpu();
+	tlb_switch_mm(proc->mm);
+	for (pg = 0; pg < FAULT_PAGES; pg++) {
+		if (pg % FAULT_CHUNK == 0) {
+			__alloc(proc, 0, pg / FAULT_CHUNK,
+				FAULT_CHUNK * PAGING_PAGESZ, &addr[pg]);
+		}else{
+			addr[pg] = addr[pg - 1] + PAGING_PAGESZ;
+		}
+		pg_setval(proc->mm, addr[pg], (BYTE)(pg ^ proc->pid), proc);
+	}
+
+	pthread_barrier_wait(fc->start);
+	double start = now_sec();
+	for (i = 0; i < fc->accesses; i++) {
+		seed = seed * 6364136223846793005UL + 1;
+		pg = (seed >> 33) % FAULT_PAGES;
+		if (i % 8 == 0) {
+			/* Same value, the page gets dirty */
+			pg_setval(proc->mm, addr[pg], (BYTE)(pg ^ proc->pid),
+				proc);
+		}else if (pg_getval(proc->mm, addr[pg], &data, proc) < 0 ||
+				data != (BYTE)(pg ^ proc->pid)) {
+			fc->errors++;
+		}
+	}
+	fc->sec = now_sec() - start;
+	tlb_detach_cpu();
+	return NULL;
+}
+
+static void bench_faults(int argc, char * argv[]) {
+	long accesses = (argc > 0) ? atol(argv[0]) : 200000;
+	int max_cpus = (argc > 1) ? atoi(argv[1]) : 32;
+	int ncpus, i;
+
+	fprintf(report, "faults: %ld accesses per CPU, %d pages per process,"
+		" MEMRAM holds half\n", accesses, FAULT_PAGES);
+	fprintf(report, "%6s %14s %12s %12s %8s\n",
+		"cpus", "accesses/s", "faults/s", "stolen", "errors");
+	for (ncpus = 1; ncpus <= max_cpus; ncpus *= 2) {
+		struct memphy_struct ram, swp;
+		struct fault_cpu_t * fc = calloc(ncpus, sizeof(struct fault_cpu_t));
+		pthread_t * tid = malloc(ncpus * sizeof(pthread_t));
+		pthread_barrier_t start;
+		unsigned long faults0, stolen0, faults, stolen;
+		long errors = 0;
+		double sec = 0;
+
+		init_memphy(&ram, ncpus * FAULT_PAGES / 2 * PAGING_PAGESZ, 1);
+		init_memphy(&swp, 16 << 20, 1);
+		reclaim_set_swap(0, &swp);
+		pthread_barrier_init(&start, NULL, ncpus);
+		reclaim_get_stats(&faults0, &stolen0);
+		for (i = 0; i < ncpus; i++) {
+			fc[i].proc.pid = i;
+			fc[i].proc.mram = &ram;
+			fc[i].proc.active_mswp = &swp;
+			fc[i].proc.mm = calloc(1, sizeof(struct mm_struct));
+			init_mm(fc[i].proc.mm, &fc[i].proc);
+			fc[i].start = &start;
+			fc[i].accesses = accesses;
+			pthread_create(&tid[i], NULL, fault_cpu, &fc[i]);
+		}
+		for (i = 0; i < ncpus; i++) {
+			pthread_join(tid[i], NULL);
+			errors += fc[i].errors;
+			if (fc[i].sec > sec)
+				sec = fc[i].sec;
+		}
+		reclaim_get_stats(&faults, &stolen);
+		fprintf(report, "%6d %14.0f %12.0f %12lu %8ld\n", ncpus,
+			ncpus * accesses / sec, (faults - faults0) / sec,
+			stolen - stolen0, errors);
+		fflush(report);
+
+		for (i = 0; i < ncpus; i++) {
+			free_pcb_memph(&fc[i].proc);
+			free_mm(fc[i].proc.mm);
+			free(fc[i].proc.mm);
+		}
+		reclaim_set_swap(0, NULL);
+		pthread_barrier_destroy(&start);
+		free_memphy(&ram);
+		free_memphy(&swp);
+		free(fc);
+		free(tid);
+	}
+}
+
+int main(int argc, char * argv[]) {
+	const char * which = (argc > 1) ? argv[1] : "all";
+	int all = !strcmp(which, "all");
+
+	report = fdopen(dup(STDOUT_FILENO), "w");
+	if (report == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+		fprintf(stderr, "bench: cannot redirect output\n");
+		return 1;
+	}
+
+	if (all || !strcmp(which, "timer")) {
+		bench_timer(argc - 2, argv + 2);
+	}
+	if (all || !strcmp(which, "queue")) {
+		bench_queue(argc - 2, argv + 2);
+	}
+	if (all || !strcmp(which, "interp")) {
+		bench_interp(argc - 2, argv + 2);
+	}
+	if (all || !strcmp(which, "load")) {
+		bench_load(argc - 2, argv + 2);
+	}
+	if (all || !strcmp(which, "frames")) {
+		bench_frames(argc - 2, argv + 2);
+	}
+	if (all || !strcmp(which, "swap")) {
+		bench_swap(argc - 2, argv + 2);
+	}
+	if (all || !strcmp(which, "tlb")) {
+		bench_tlb(argc - 2, argv + 2);
+	}
+	if (all || !strcmp(which, "faults")) {
+		bench_faults(argc - 2, argv + 2);
+	}
+	fclose(report);
+	return 0;
+}
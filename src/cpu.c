@@ -2,6 +2,13 @@
 #include "cpu.h"
 #include "mem.h"
 #include "mm.h"
+#include "loader.h"
+#include "sched.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+atomic_int nr_live_procs;
 
 int calc(struct pcb_t * proc) {
 	return ((unsigned long)proc & 0UL);
@@ -45,53 +52,122 @@ int write(
 	return write_mem(proc->regs[destination] + offset, proc, data);
 } 
 
+/* Instruction handlers, bound to the pre-decoded text by decode(), which
+ * also turns an unknown opcode into exec_invalid() once at load time */
+static int exec_calc(struct pcb_t * proc, const struct dinst_t * ins) {
+	/* Same as calc(), without the second call */
+	return 0;
+}
+
+#ifdef MM_PAGING
+static int exec_alloc(struct pcb_t * proc, const struct dinst_t * ins) {
+	return pgalloc(proc, ins->arg_0, ins->arg_1);
+}
+
+static int exec_free(struct pcb_t * proc, const struct dinst_t * ins) {
+	return pgfree_data(proc, ins->arg_0);
+}
+
+static int exec_read(struct pcb_t * proc, const struct dinst_t * ins) {
+	return pgread(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int exec_write(struct pcb_t * proc, const struct dinst_t * ins) {
+	return pgwrite(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int exec_fork(struct pcb_t * proc, const struct dinst_t * ins) {
+	/* The child shares the frames of the parent copy-on-write */
+	struct pcb_t * child = clone_pcb(proc);
+	if (child == NULL) {
+		return 1;
+	}
+	child->mm = (struct mm_struct *)malloc(sizeof(struct mm_struct));
+	if (child->mm == NULL || fork_mm(child, proc)) {
+		free(child->mm);
+		unload(child);
+		return 1;
+	}
+	printf("\tProcess %2d forked process %2d\n", proc->pid, child->pid);
+	atomic_fetch_add(&nr_live_procs, 1);
+	add_proc(child);
+	return 0;
+}
+#else
+static int exec_alloc(struct pcb_t * proc, const struct dinst_t * ins) {
+	return alloc(proc, ins->arg_0, ins->arg_1);
+}
+
+static int exec_free(struct pcb_t * proc, const struct dinst_t * ins) {
+	return free_data(proc, ins->arg_0);
+}
+
+static int exec_read(struct pcb_t * proc, const struct dinst_t * ins) {
+	return read(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int exec_write(struct pcb_t * proc, const struct dinst_t * ins) {
+	return write(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int exec_fork(struct pcb_t * proc, const struct dinst_t * ins) {
+	return 1;	/* The paging-less memory has no way to share frames */
+}
+#endif
+
+static int exec_invalid(struct pcb_t * proc, const struct dinst_t * ins) {
+	return 1;
+}
+
+static const inst_handler_t inst_handlers[] = {
+	[CALC] = exec_calc,
+	[ALLOC] = exec_alloc,
+	[FREE] = exec_free,
+	[READ] = exec_read,
+	[WRITE] = exec_write,
+	[FORK] = exec_fork,
+};
+
+#define NUM_HANDLERS (sizeof(inst_handlers) / sizeof(inst_handlers[0]))
+
+int decode(struct code_seg_t * code) {
+	uint32_t i;
+	code->dtext = (struct dinst_t *)malloc(
+		sizeof(struct dinst_t) * code->size);
+	if (code->dtext == NULL && code->size != 0) {
+		return 1;
+	}
+	for (i = 0; i < code->size; i++) {
+		const struct inst_t * ins = &code->text[i];
+		struct dinst_t * dins = &code->dtext[i];
+		dins->opcode = ins->opcode;
+		dins->handler = ((unsigned)ins->opcode < NUM_HANDLERS) ?
+			inst_handlers[ins->opcode] : exec_invalid;
+		dins->arg_0 = ins->arg_0;
+		dins->arg_1 = ins->arg_1;
+		dins->arg_2 = ins->arg_2;
+	}
+	return 0;
+}
+
 int run(struct pcb_t * proc) {
 	/* Check if Program Counter point to the proper instruction */
 	if (proc->pc >= proc->code->size) {
 		return 1;
 	}
-	struct inst_t ins = proc->code->text[proc->pc];
+	const struct dinst_t * ins = &proc->code->dtext[proc->pc];
 	proc->pc++;
-	int stat = 1;
-	switch (ins.opcode) {
-	case CALC:
-		stat = calc(proc);
-		break;
-	case ALLOC:
-#ifdef MM_PAGING
-		stat = pgalloc(proc, ins.arg_0, ins.arg_1);
+	return ins->handler(proc, ins);
+}
 
-#else
-		stat = alloc(proc, ins.arg_0, ins.arg_1);
-#endif
-		break;
-	case FREE:
-#ifdef MM_PAGING
-		stat = pgfree_data(proc, ins.arg_0);
-#else
-		stat = free_data(proc, ins.arg_0);
-#endif
-		break;
-	case READ:
-#ifdef MM_PAGING
-		stat = pgread(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#else
-		stat = read(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#endif
-		break;
-	case WRITE:
-#ifdef MM_PAGING
-		stat = pgwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#else
-		stat = write(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#endif
-		break;
-	default:
-		stat = 1;
+uint32_t run_calc(struct pcb_t * proc, uint32_t max) {
+	uint32_t n = 0;
+	while (n < max && proc->pc < proc->code->size &&
+			proc->code->dtext[proc->pc].opcode == CALC) {
+		calc(proc);
+		proc->pc++;
+		n++;
 	}
-	return stat;
-
+	return n;
 }
 
-
-
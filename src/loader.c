@@ -1,16 +1,24 @@
 
 #include "loader.h"
+#include "cpu.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-static uint32_t avail_pid = 1;
+static atomic_uint avail_pid = 1;	// FORK takes PIDs on the CPUs
 
 #define OPT_CALC	"calc"
 #define OPT_ALLOC	"alloc"
 #define OPT_FREE	"free"
 #define OPT_READ	"read"
 #define OPT_WRITE	"write"
+#define OPT_FORK	"fork"
 
 static enum ins_opcode_t get_opcode(char * opt) {
 	if (!strcmp(opt, OPT_CALC)) {
@@ -23,33 +31,20 @@ static enum ins_opcode_t get_opcode(char * opt) {
 		return READ;
 	}else if (!strcmp(opt, OPT_WRITE)) {
 		return WRITE;
+	}else if (!strcmp(opt, OPT_FORK)) {
+		return FORK;
 	}else{
 		printf("Opcode: %s\n", opt);
 		exit(1);
 	}
 }
 
-struct pcb_t * load(const char * path) {
-	/* Create new PCB for the new process */
-	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
-	proc->page_table =
-		(struct page_table_t*)malloc(sizeof(struct page_table_t));
-	proc->bp = PAGE_SIZE;
-	proc->pc = 0;
-
-	/* Read process code from file */
-	FILE * file;
-	if ((file = fopen(path, "r")) == NULL) {
-		printf("Cannot find process description at '%s'\n", path);
-		exit(1);		
-	}
+/* Parse the text program in [file] into [proc] */
+static void load_text(struct pcb_t * proc, FILE * file) {
 	char opcode[10];
-	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
 	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
-	proc->code->text = (struct inst_t*)malloc(
-		sizeof(struct inst_t) * proc->code->size
+	proc->code->text = (struct inst_t*)calloc(
+		proc->code->size, sizeof(struct inst_t)
 	);
 	uint32_t i = 0;
 	for (i = 0; i < proc->code->size; i++) {
@@ -57,6 +52,7 @@ struct pcb_t * load(const char * path) {
 		proc->code->text[i].opcode = get_opcode(opcode);
 		switch(proc->code->text[i].opcode) {
 		case CALC:
+		case FORK:
 			break;
 		case ALLOC:
 			fscanf(
@@ -84,8 +80,278 @@ struct pcb_t * load(const char * path) {
 			exit(1);
 		}
 	}
+}
+
+/* Load the program image open at [fd], whose header [hdr] is already
+ * read. Large images are mapped read-only and shared and their
+ * instructions are used in place, so processes started from the same
+ * file share the physical pages of their text. Small ones are cheaper
+ * to read than to map */
+static void load_image(struct pcb_t * proc, int fd,
+		const struct prog_header_t * hdr, const char * path) {
+	struct code_seg_t * code = proc->code;
+	uint64_t len = sizeof(*hdr) + (uint64_t)hdr->size * sizeof(struct inst_t);
+	struct stat st;
+	uint32_t i;
+
+	if (hdr->version != PROG_VERSION || fstat(fd, &st) || st.st_size < len) {
+		printf("Bad program image at '%s'\n", path);
+		exit(1);
+	}
+	proc->priority = hdr->priority;
+	code->size = hdr->size;
+	if (len >= PROG_MAP_MIN) {
+		code->image = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+		if (code->image == MAP_FAILED) {
+			printf("Cannot map program image at '%s'\n", path);
+			exit(1);
+		}
+		code->image_len = len;
+		code->text = (struct inst_t *)
+			((struct prog_header_t *)code->image + 1);
+	}else{
+		code->text = (struct inst_t *)malloc(len - sizeof(*hdr));
+		if (pread(fd, code->text, len - sizeof(*hdr), sizeof(*hdr))
+				!= len - sizeof(*hdr)) {
+			printf("Bad program image at '%s'\n", path);
+			exit(1);
+		}
+	}
+	for (i = 0; i < code->size; i++) {
+		if ((unsigned)code->text[i].opcode > FORK) {
+			printf("Opcode: %u\n", code->text[i].opcode);
+			exit(1);
+		}
+	}
+}
+
+/* Read the program at [path] into a new code segment of [proc], an
+ * image is told from a text program by its magic */
+static void read_program(struct pcb_t * proc, const char * path) {
+	struct prog_header_t hdr;
+	int fd;
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		printf("Cannot find process description at '%s'\n", path);
+		exit(1);		
+	}
+	proc->code = (struct code_seg_t*)calloc(1, sizeof(struct code_seg_t));
+	/* read() is taken by the READ instruction of cpu.c */
+	if (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+			!memcmp(hdr.magic, PROG_MAGIC, PROG_MAGIC_LEN)) {
+		load_image(proc, fd, &hdr, path);
+		close(fd);
+	}else{
+		FILE * file = fdopen(fd, "r");
+		load_text(proc, file);
+		fclose(file);
+	}
+	if (decode(proc->code)) {
+		printf("Cannot decode process at '%s'\n", path);
+		exit(1);
+	}
+	proc->code->refs = 1;
+}
+
+static void free_code(struct code_seg_t * code) {
+	if (code->image != NULL) {
+		munmap(code->image, code->image_len);
+	}else{
+		free(code->text);
+	}
+	free(code->dtext);
+	free(code);
+}
+
+/* Program cache: the code segment and priority of every program already
+ * loaded, looked up by path. The cache holds a reference on each code
+ * segment, so they are kept until finish_loader() */
+struct prog_entry_t {
+	char * path;
+	struct code_seg_t * code;
+	uint32_t priority;
+	struct prog_entry_t * next;
+};
+
+static int prog_cache_on = 1;
+static struct prog_entry_t ** prog_cache;
+static uint32_t prog_cache_buckets;	// Power of 2
+static uint32_t prog_cache_count;
+static unsigned long prog_cache_hits;
+static unsigned long prog_cache_misses;
+/* Protects the cache and the reference counts of the code segments */
+static pthread_mutex_t prog_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t hash_path(const char * path) {
+	uint32_t h = 2166136261u;	// FNV-1a
+	while (*path) {
+		h = (h ^ (unsigned char)*path++) * 16777619u;
+	}
+	return h;
+}
+
+static void grow_prog_cache(void) {
+	uint32_t buckets = prog_cache_buckets ? prog_cache_buckets * 2 : 64;
+	struct prog_entry_t ** table =
+		(struct prog_entry_t **)calloc(buckets, sizeof(*table));
+	uint32_t i;
+
+	if (table == NULL) {
+		return;		// Keep the current table, only longer chains
+	}
+	for (i = 0; i < prog_cache_buckets; i++) {
+		struct prog_entry_t * e = prog_cache[i];
+		while (e != NULL) {
+			struct prog_entry_t * next = e->next;
+			uint32_t b = hash_path(e->path) & (buckets - 1);
+			e->next = table[b];
+			table[b] = e;
+			e = next;
+		}
+	}
+	free(prog_cache);
+	prog_cache = table;
+	prog_cache_buckets = buckets;
+}
+
+/* Give [proc] the cached code of [path], reading it on a miss */
+static void load_cached(struct pcb_t * proc, const char * path) {
+	struct prog_entry_t * e;
+	uint32_t h = hash_path(path);
+
+	pthread_mutex_lock(&prog_cache_lock);
+	if (prog_cache_count >= prog_cache_buckets) {
+		grow_prog_cache();
+	}
+	for (e = prog_cache[h & (prog_cache_buckets - 1)]; e; e = e->next) {
+		if (!strcmp(e->path, path)) {
+			break;
+		}
+	}
+	if (e != NULL) {
+		prog_cache_hits++;
+		e->code->refs++;
+		proc->code = e->code;
+		proc->priority = e->priority;
+		pthread_mutex_unlock(&prog_cache_lock);
+		return;
+	}
+	prog_cache_misses++;
+	read_program(proc, path);
+	e = (struct prog_entry_t *)malloc(sizeof(struct prog_entry_t));
+	e->path = strdup(path);
+	e->code = proc->code;
+	e->code->refs++;
+	e->priority = proc->priority;
+	e->next = prog_cache[h & (prog_cache_buckets - 1)];
+	prog_cache[h & (prog_cache_buckets - 1)] = e;
+	prog_cache_count++;
+	pthread_mutex_unlock(&prog_cache_lock);
+}
+
+void set_loader_cache(int enable) {
+	prog_cache_on = enable;
+}
+
+struct pcb_t * load(const char * path) {
+	/* Create new PCB for the new process */
+	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
+	proc->pid = atomic_fetch_add(&avail_pid, 1);
+#ifdef MM_PAGING
+	/* The legacy page table is only used by mem.c */
+	proc->page_table = NULL;
+#else
+	proc->page_table =
+		(struct page_table_t*)malloc(sizeof(struct page_table_t));
+#endif
+	proc->bp = PAGE_SIZE;
+	proc->pc = 0;
+
+	/* Read process code from file or share the cached one */
+	if (prog_cache_on) {
+		load_cached(proc, path);
+	}else{
+		read_program(proc, path);
+	}
 	return proc;
 }
 
+struct pcb_t * clone_pcb(const struct pcb_t * parent) {
+	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
+	if (proc == NULL) {
+		return NULL;
+	}
+	*proc = *parent;
+	proc->pid = atomic_fetch_add(&avail_pid, 1);
+	proc->page_table = NULL;
+#ifdef MM_PAGING
+	proc->mm = NULL;
+#endif
+
+	/* Same code segment, one more reference on it */
+	pthread_mutex_lock(&prog_cache_lock);
+	proc->code->refs++;
+	pthread_mutex_unlock(&prog_cache_lock);
+	return proc;
+}
+
+void unload(struct pcb_t * proc) {
+	struct code_seg_t * code = proc->code;
+	uint32_t refs;
+
+	pthread_mutex_lock(&prog_cache_lock);
+	refs = --code->refs;
+	pthread_mutex_unlock(&prog_cache_lock);
+	if (refs == 0) {
+		free_code(code);
+	}
+	free(proc->page_table);
+	free(proc);
+}
+
+void finish_loader(void) {
+	uint32_t i;
 
+	if (prog_cache_hits + prog_cache_misses > 0) {
+		printf("Program cache: %u programs, %lu hits, %lu misses\n",
+			prog_cache_count, prog_cache_hits, prog_cache_misses);
+	}
+	pthread_mutex_lock(&prog_cache_lock);
+	for (i = 0; i < prog_cache_buckets; i++) {
+		struct prog_entry_t * e = prog_cache[i];
+		while (e != NULL) {
+			struct prog_entry_t * next = e->next;
+			if (--e->code->refs == 0) {
+				free_code(e->code);
+			}
+			free(e->path);
+			free(e);
+			e = next;
+		}
+	}
+	free(prog_cache);
+	prog_cache = NULL;
+	prog_cache_buckets = prog_cache_count = 0;
+	prog_cache_hits = prog_cache_misses = 0;
+	pthread_mutex_unlock(&prog_cache_lock);
+}
+
+int save_image(const char * path, uint32_t priority,
+		const struct code_seg_t * code) {
+	struct prog_header_t hdr;
+	FILE * file;
+	int err;
+
+	if ((file = fopen(path, "wb")) == NULL) {
+		return 1;
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, PROG_MAGIC, PROG_MAGIC_LEN);
+	hdr.version = PROG_VERSION;
+	hdr.priority = priority;
+	hdr.size = code->size;
+	err = fwrite(&hdr, sizeof(hdr), 1, file) != 1 ||
+		fwrite(code->text, sizeof(struct inst_t), code->size, file)
+			!= code->size;
+	return fclose(file) || err;
+}
 
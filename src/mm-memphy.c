@@ -6,24 +6,58 @@
 
 #include "mm.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Time charged to the calling thread by its accesses, all of it and the
+ * part already turned into stalled slots */
+static _Thread_local uint64_t memphy_charge;
+static _Thread_local uint64_t memphy_taken;
 
 /*
  *  MEMPHY_mv_csr - move MEMPHY cursor
  *  @mp: memphy struct
  *  @offset: offset
+ *  Return the number of bytes the cursor travelled
  */
 int MEMPHY_mv_csr(struct memphy_struct *mp, int offset)
 {
-   int numstep = 0;
+   int dist = offset - atomic_exchange_explicit(&mp->cursor,
+                         offset % mp->maxsz, memory_order_relaxed);
 
-   mp->cursor = 0;
-   while(numstep < offset && numstep < mp->maxsz){
-     /* Traverse sequentially */
-     mp->cursor = (mp->cursor + 1) % mp->maxsz;
-     numstep++;
-   }
+   return (dist < 0) ? -dist : dist;
+}
 
-   return 0;
+/*
+ *  MEMPHY_access - account an access of len bytes at addr
+ *  @mp: memphy struct
+ *  @addr: address
+ *  @len: bytes transferred
+ *
+ *  The cursor seeks to addr and ends past the access. The time of the
+ *  access is added to the busy time of the device and charged to the
+ *  calling thread
+ */
+static void MEMPHY_access(struct memphy_struct *mp, int addr, int len)
+{
+   uint64_t dist = MEMPHY_mv_csr(mp, addr);
+   uint64_t cost;
+
+   atomic_store_explicit(&mp->cursor, (addr + len) % mp->maxsz,
+                         memory_order_relaxed);
+   if (!mp->timed)
+     return;
+
+   cost = mp->lat_cost + mp->seek_cost * dist / 1024 +
+          mp->xfer_cost * (uint64_t)len / 1024;
+   memphy_charge += cost;
+   atomic_fetch_add_explicit(&mp->busy, cost, memory_order_relaxed);
+   atomic_fetch_add_explicit(&mp->nr_access, 1, memory_order_relaxed);
+   atomic_fetch_add_explicit(&mp->nr_bytes, len, memory_order_relaxed);
+   atomic_fetch_add_explicit(&mp->seek_bytes, dist, memory_order_relaxed);
 }
 
 /*
@@ -37,10 +71,10 @@ int MEMPHY_seq_read(struct memphy_struct *mp, int addr, BYTE *value)
    if (mp == NULL)
      return -1;
 
-   if (!mp->rdmflg)
+   if (mp->rdmflg)
      return -1; /* Not compatible mode for sequential read */
 
-   MEMPHY_mv_csr(mp, addr);
+   MEMPHY_access(mp, addr, 1);
    *value = (BYTE) mp->storage[addr];
 
    return 0;
@@ -57,9 +91,11 @@ int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value)
    if (mp == NULL)
      return -1;
 
-   if (mp->rdmflg)
+   if (mp->rdmflg) {
+      if (mp->timed)
+         MEMPHY_access(mp, addr, 1);
       *value = mp->storage[addr];
-   else /* Sequential access device */
+   } else /* Sequential access device */
       return MEMPHY_seq_read(mp, addr, value);
 
    return 0;
@@ -77,10 +113,10 @@ int MEMPHY_seq_write(struct memphy_struct * mp, int addr, BYTE value)
    if (mp == NULL)
      return -1;
 
-   if (!mp->rdmflg)
-     return -1; /* Not compatible mode for sequential read */
+   if (mp->rdmflg)
+     return -1; /* Not compatible mode for sequential write */
 
-   MEMPHY_mv_csr(mp, addr);
+   MEMPHY_access(mp, addr, 1);
    mp->storage[addr] = value;
 
    return 0;
@@ -97,60 +133,210 @@ int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data)
    if (mp == NULL)
      return -1;
 
-   if (mp->rdmflg)
+   if (mp->rdmflg) {
+      if (mp->timed)
+         MEMPHY_access(mp, addr, 1);
       mp->storage[addr] = data;
-   else /* Sequential access device */
+   } else /* Sequential access device */
       return MEMPHY_seq_write(mp, addr, data);
 
    return 0;
 }
 
+/*
+ *  MEMPHY_cp_frame - copy a whole frame, the devices may differ
+ *  @mpsrc: source memphy
+ *  @srcfpn: source frame
+ *  @mpdst: destination memphy
+ *  @dstfpn: destination frame
+ *  @pagesz: frame size
+ *
+ *  The frame is moved with a single memcpy, accounted as one access of
+ *  pagesz bytes on each device
+ */
+int MEMPHY_cp_frame(struct memphy_struct *mpsrc, int srcfpn,
+                    struct memphy_struct *mpdst, int dstfpn, int pagesz)
+{
+   int srcaddr = srcfpn * pagesz;
+   int dstaddr = dstfpn * pagesz;
+
+   if (mpsrc == NULL || mpdst == NULL)
+     return -1;
+
+   if (srcfpn < 0 || srcaddr + pagesz > mpsrc->maxsz ||
+       dstfpn < 0 || dstaddr + pagesz > mpdst->maxsz)
+     return -1;
+
+   MEMPHY_access(mpsrc, srcaddr, pagesz);
+   MEMPHY_access(mpdst, dstaddr, pagesz);
+
+   if (mpsrc != mpdst || srcaddr != dstaddr)
+     memcpy(mpdst->storage + dstaddr, mpsrc->storage + srcaddr, pagesz);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_zero - clear len bytes, accounted as one access
+ *  @mp: memphy struct
+ *  @addr: address
+ *  @len: bytes cleared
+ */
+int MEMPHY_zero(struct memphy_struct *mp, int addr, int len)
+{
+   if (mp == NULL || addr < 0 || addr + len > mp->maxsz)
+     return -1;
+
+   MEMPHY_access(mp, addr, len);
+   memset(mp->storage + addr, 0, len);
+
+   return 0;
+}
+
+/*
+ *  Free frames are tracked in a bitmap, one bit per frame set while the
+ *  frame is in use. The bitmap is lock free so the CPUs take and give
+ *  back frames of a device in parallel: a frame is taken by reserving
+ *  one in [nr_free] first, then setting a clear bit with a
+ *  compare-and-swap on its word. The search starts at the word of
+ *  [fp_hint], a recently freed or the next unused frame
+ */
+#define FP_WORD_BITS 64
+#define FP_WORDS(numfp) (((numfp) + FP_WORD_BITS - 1) / FP_WORD_BITS)
+
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
  */
 int MEMPHY_format(struct memphy_struct *mp, int pagesz)
 {
-    /* This setting come with fixed constant PAGESZ */
+    /* Frames of the page size chosen at startup */
     int numfp = mp->maxsz / pagesz;
-    struct framephy_struct *newfst, *fst;
-    int iter = 0;
+    int nwords = FP_WORDS(numfp);
+
+    mp->numfp = (numfp > 0) ? numfp : 0;
+    atomic_init(&mp->nr_free, mp->numfp);
+    atomic_init(&mp->fp_hint, 0);
+    mp->fp_bitmap = NULL;
+    mp->fp_tbl = NULL;
 
     if (numfp <= 0)
       return -1;
 
-    /* Init head of free framephy list */ 
-    fst = malloc(sizeof(struct framephy_struct));
-    fst->fpn = iter;
-    mp->free_fp_list = fst;
-
-    /* We have list with first element, fill in the rest num-1 element member*/
-    for (iter = 1; iter < numfp ; iter++)
-    {
-       newfst =  malloc(sizeof(struct framephy_struct));
-       newfst->fpn = iter;
-       newfst->fp_next = NULL;
-       fst->fp_next = newfst;
-       fst = newfst;
+    mp->fp_bitmap = calloc(nwords, sizeof(uint64_t));
+    /* Entries are filled when their frame is handed out, the untouched
+     * ones of a large device cost no host memory */
+    mp->fp_tbl = calloc(numfp, sizeof(struct framephy_struct));
+    if (mp->fp_bitmap == NULL || mp->fp_tbl == NULL) {
+      free((void *)mp->fp_bitmap);
+      free(mp->fp_tbl);
+      mp->fp_bitmap = NULL;
+      mp->fp_tbl = NULL;
+      mp->numfp = 0;
+      atomic_store(&mp->nr_free, 0);
+      return -1;
     }
+    /* Frames past the end of the device are never free */
+    if (numfp % FP_WORD_BITS)
+      mp->fp_bitmap[nwords - 1] = ~0ULL << (numfp % FP_WORD_BITS);
 
     return 0;
 }
 
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
+   int nwords = FP_WORDS(mp->numfp);
+   int w, fpn;
+   uint64_t word;
 
-   if (fp == NULL)
+   /* Reserve a frame, there is a clear bit for it from now on */
+   if (atomic_fetch_sub(&mp->nr_free, 1) <= 0) {
+     atomic_fetch_add(&mp->nr_free, 1);
      return -1;
+   }
 
-   *retfpn = fp->fpn;
-   mp->free_fp_list = fp->fp_next;
+   /* Find a zero from the hint on, wrapping around. A frame freed behind
+    * the search is found on the next round */
+   w = atomic_load_explicit(&mp->fp_hint, memory_order_relaxed) /
+       FP_WORD_BITS % nwords;
+   for (;;)
+   {
+     word = atomic_load_explicit(&mp->fp_bitmap[w], memory_order_relaxed);
+     if (~word == 0) {
+       w = (w + 1) % nwords;
+       continue;
+     }
+     fpn = __builtin_ctzll(~word);
+     if (atomic_compare_exchange_weak_explicit(&mp->fp_bitmap[w], &word,
+           word | (1ULL << fpn), memory_order_acquire, memory_order_relaxed))
+       break;
+   }
 
-   /* MEMPHY is iteratively used up until its exhausted
-    * No garbage collector acting then it not been released
-    */
-   free(fp);
+   *retfpn = w * FP_WORD_BITS + fpn;
+   atomic_store_explicit(&mp->fp_hint, *retfpn + 1, memory_order_relaxed);
+
+   mp->fp_tbl[*retfpn].fpn = *retfpn;
+   mp->fp_tbl[*retfpn].owner = NULL;
+   mp->fp_tbl[*retfpn].pgn = -1;
+   mp->fp_tbl[*retfpn].swptyp = 0;
+   mp->fp_tbl[*retfpn].swpoff = -1;
+   atomic_store_explicit(&mp->fp_tbl[*retfpn].refs, 1, memory_order_relaxed);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_get_freefp_range - take a run of contiguous free frames
+ *  @mp: memphy struct
+ *  @nr: number of frames, a power of two up to FP_WORD_BITS
+ *  @retfpn: first frame of the run, a multiple of nr
+ *
+ *  The run is taken with a single compare-and-swap on a bitmap word.
+ *  Free frames scattered over the words are not gathered, -1 is
+ *  returned when no aligned run is free
+ */
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int nr, int *retfpn)
+{
+   int nwords = FP_WORDS(mp->numfp);
+   uint64_t mask, word;
+   int w, bit, fpn;
+
+   if (nr <= 0 || nr > FP_WORD_BITS || (nr & (nr - 1)))
+     return -1;
+   mask = (nr == FP_WORD_BITS) ? ~0ULL : (1ULL << nr) - 1;
+
+   if (atomic_fetch_sub(&mp->nr_free, nr) < nr) {
+     atomic_fetch_add(&mp->nr_free, nr);
+     return -1;
+   }
+
+   for (w = 0; w < nwords; w++)
+   {
+     word = atomic_load_explicit(&mp->fp_bitmap[w], memory_order_relaxed);
+     for (bit = 0; bit < FP_WORD_BITS; bit += nr)
+     {
+       if (word & (mask << bit))
+         continue;
+       if (atomic_compare_exchange_weak_explicit(&mp->fp_bitmap[w], &word,
+             word | (mask << bit), memory_order_acquire, memory_order_relaxed))
+         goto found;
+       bit = -nr; /* The word changed, look at it again */
+     }
+   }
+   atomic_fetch_add(&mp->nr_free, nr);
+   return -1;
+
+found:
+   *retfpn = w * FP_WORD_BITS + bit;
+   for (fpn = *retfpn; fpn < *retfpn + nr; fpn++)
+   {
+     mp->fp_tbl[fpn].fpn = fpn;
+     mp->fp_tbl[fpn].owner = NULL;
+     mp->fp_tbl[fpn].pgn = -1;
+     mp->fp_tbl[fpn].swptyp = 0;
+     mp->fp_tbl[fpn].swpoff = -1;
+     atomic_store_explicit(&mp->fp_tbl[fpn].refs, 1, memory_order_relaxed);
+   }
 
    return 0;
 }
@@ -176,34 +362,204 @@ int MEMPHY_dump(struct memphy_struct * mp)
 
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
-   struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
+   uint64_t bit;
+
+   if (fpn < 0 || fpn >= mp->numfp)
+     return -1;
+   bit = 1ULL << (fpn % FP_WORD_BITS);
+
+   if (!(atomic_load(&mp->fp_bitmap[fpn / FP_WORD_BITS]) & bit))
+     return 0; /* Already free */
+
+   /* The entry is no one's once the bit is clear */
+   mp->fp_tbl[fpn].owner = NULL;
+   mp->fp_tbl[fpn].pgn = -1;
+   mp->fp_tbl[fpn].swpoff = -1;
+   if (!(atomic_fetch_and_explicit(&mp->fp_bitmap[fpn / FP_WORD_BITS], ~bit,
+                                   memory_order_release) & bit))
+     return 0;
+   atomic_store_explicit(&mp->fp_hint, fpn, memory_order_relaxed);
+   atomic_fetch_add(&mp->nr_free, 1);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_set_timing - set the timing model of a device, in thousandths
+ *                      of a slot (MEMPHY_COST_UNIT)
+ *  @mp: memphy struct
+ *  @lat: cost of every access
+ *  @seek: cost per KB the cursor travels to reach the access
+ *  @xfer: cost per KB transferred
+ */
+int MEMPHY_set_timing(struct memphy_struct *mp, int lat, int seek, int xfer)
+{
+   if (lat < 0 || seek < 0 || xfer < 0)
+     return -1;
 
-   /* Create new node with value fpn */
-   newnode->fpn = fpn;
-   newnode->fp_next = fp;
-   mp->free_fp_list = newnode;
+   mp->lat_cost = lat;
+   mp->seek_cost = seek;
+   mp->xfer_cost = xfer;
+   mp->timed = (lat | seek | xfer) != 0;
 
    return 0;
 }
 
+/*
+ *  MEMPHY_cost - time of an access of len bytes, leaving the seek out
+ *  @mp: memphy struct
+ *  @len: bytes transferred
+ */
+uint64_t MEMPHY_cost(struct memphy_struct *mp, int len)
+{
+   return mp->lat_cost + mp->xfer_cost * (uint64_t)len / 1024;
+}
+
+/*
+ *  MEMPHY_charged - time charged to the calling thread so far
+ */
+uint64_t MEMPHY_charged(void)
+{
+   return memphy_charge;
+}
+
+/*
+ *  MEMPHY_take_stall - whole slots charged to the calling thread since
+ *                      the previous call, the remainder is carried over
+ */
+uint32_t MEMPHY_take_stall(void)
+{
+   uint32_t slots = (memphy_charge - memphy_taken) / MEMPHY_COST_UNIT;
+
+   memphy_taken += (uint64_t)slots * MEMPHY_COST_UNIT;
+   return slots;
+}
+
+/*
+ *  MEMPHY_report - print the busy time of a timed device
+ *  @mp: memphy struct
+ *  @name: device name
+ */
+void MEMPHY_report(struct memphy_struct *mp, const char *name)
+{
+   if (!mp->timed)
+     return;
+
+   printf("\t%s: busy %.2f slots, %lu accesses, %lu KB transferred,"
+          " %lu KB seeked\n", name,
+          (double)atomic_load(&mp->busy) / MEMPHY_COST_UNIT,
+          atomic_load(&mp->nr_access), atomic_load(&mp->nr_bytes) / 1024,
+          atomic_load(&mp->seek_bytes) / 1024);
+}
+
+/*
+ *  MEMPHY_set_owner - record which page of which mm uses a frame
+ *  @mp: memphy struct
+ *  @fpn: frame in use
+ *  @owner: mm the frame is given to
+ *  @pgn: page mapped in the frame, -1 if not mapped yet
+ */
+int MEMPHY_set_owner(struct memphy_struct *mp, int fpn,
+                     struct mm_struct *owner, int pgn)
+{
+   if (fpn < 0 || fpn >= mp->numfp)
+     return -1;
+
+   mp->fp_tbl[fpn].owner = owner;
+   mp->fp_tbl[fpn].pgn = pgn;
+
+   return 0;
+}
 
 /*
  *  Init MEMPHY struct
  */
-int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
+static int memphy_setup(struct memphy_struct *mp, int max_size, int randomflg)
 {
-   mp->storage = (BYTE *)malloc(max_size*sizeof(BYTE));
    mp->maxsz = max_size;
 
    MEMPHY_format(mp,PAGING_PAGESZ);
 
    mp->rdmflg = (randomflg != 0)?1:0;
 
-   if (!mp->rdmflg )   /* Not Ramdom acess device, then it serial device*/
-      mp->cursor = 0;
+   atomic_init(&mp->cursor, 0);
+   MEMPHY_set_timing(mp, 0, 0, 0);
+   atomic_init(&mp->busy, 0);
+   atomic_init(&mp->nr_access, 0);
+   atomic_init(&mp->nr_bytes, 0);
+   atomic_init(&mp->seek_bytes, 0);
 
    return 0;
 }
 
+int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
+{
+   mp->storage = (BYTE *)malloc(max_size*sizeof(BYTE));
+   mp->mapped = 0;
+
+   return memphy_setup(mp, max_size, randomflg);
+}
+
+/*
+ *  init_memphy_mapped - init a MEMPHY device whose storage is mapped, the
+ *                       host only backs the pages touched
+ *  @mp: memphy struct
+ *  @max_size: device size
+ *  @randomflg: random access device
+ *  @path: file holding the storage, created sparse and kept after the
+ *         run, so a later run maps the same contents. NULL maps
+ *         anonymous memory without reserving swap space on the host
+ */
+int init_memphy_mapped(struct memphy_struct *mp, int max_size, int randomflg,
+                       const char *path)
+{
+   void *storage;
+   int fd = -1;
+
+   if (max_size <= 0)
+     return init_memphy(mp, max_size, randomflg);
+
+   if (path == NULL) {
+     storage = mmap(NULL, max_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   } else {
+     fd = open(path, O_RDWR | O_CREAT, 0644);
+     if (fd < 0)
+       return -1;
+     /* Growing the file leaves a hole, shrinking it keeps the front */
+     if (ftruncate(fd, max_size) < 0) {
+       close(fd);
+       return -1;
+     }
+     storage = mmap(NULL, max_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    fd, 0);
+     close(fd);
+   }
+   if (storage == MAP_FAILED)
+     return -1;
+
+   mp->storage = (BYTE *)storage;
+   mp->mapped = 1;
+
+   return memphy_setup(mp, max_size, randomflg);
+}
+
+/*
+ *  free_memphy - release the storage and tables of a MEMPHY device, the
+ *                contents of a file-backed one stay in its file
+ *  @mp: memphy struct
+ */
+void free_memphy(struct memphy_struct *mp)
+{
+   if (mp->mapped)
+     munmap(mp->storage, mp->maxsz);
+   else
+     free(mp->storage);
+   free((void *)mp->fp_bitmap);
+   free(mp->fp_tbl);
+   mp->storage = NULL;
+   mp->fp_bitmap = NULL;
+   mp->fp_tbl = NULL;
+}
+
 //#endif
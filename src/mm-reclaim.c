@@ -0,0 +1,709 @@
+//#ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Global frame reclaim module mm/mm-reclaim.c
+ *
+ * Every live mm is registered here and the MEMRAM ownership table
+ * (memphy_struct.fp_tbl) tells which page of which mm uses each frame.
+ * When MEMRAM is full, a frame is taken from the mm holding the most
+ * frames, whichever process it belongs to, its page being chosen by the
+ * page replacement policy.
+ *
+ * Locking: the frame bitmaps of the devices are lock free. The page
+ * table and the resident set of an mm are protected by the lock of the
+ * mm (mm_lock()), so CPUs fault pages of different processes in
+ * parallel as long as MEMRAM has free frames. The registry and the
+ * eviction are serialized by the reclaim lock, which is always taken
+ * before the lock of an mm: a CPU holding the lock of its mm never waits
+ * for the reclaim lock
+ *
+ * Pages are swapped out over every MEMSWP device, the swap type field of
+ * the PTE naming the device, by the placement selected with
+ * reclaim_set_swap_place(). Moving a page between MEMRAM and a device
+ * costs the time of the device model (MEMPHY_set_timing()), which the
+ * CPU taking the fault spends stalled. The optional kswapd device
+ * pages cold pages out ahead of time to keep the number of free frames
+ * between two watermarks, so faults mostly find a free frame
+ *
+ * A page brought in from swap keeps its swap frame (fp_tbl[].swpoff)
+ * until it is written, tracked by the dirty bit of its PTE, so a clean
+ * page is evicted by just pointing its PTE back at that copy
+ *
+ * FORK shares the MEMRAM frames of the parent with the child, both PTEs
+ * write protected by the COW bit and the frame counting its PTEs
+ * (fp_tbl[].refs). The first write through either PTE copies the frame,
+ * unless the other PTE has let go of it meanwhile. A shared frame
+ * evicted from one mm gets that mm a swap frame of its own and stays in
+ * MEMRAM for the others
+ */
+
+#include "mm.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+static pthread_mutex_t reclaim_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct mm_struct *mm_list;
+
+static atomic_ulong reclaim_stolen;  /* Frames taken from another mm */
+static atomic_ulong reclaim_exited;  /* Frames freed by finished processes */
+static atomic_ulong reclaim_written; /* Evicted pages copied to swap */
+static atomic_ulong reclaim_clean;   /* Clean pages dropped without a copy */
+
+/* FORK, pages shared copy-on-write or copied at the fork, and shared
+ * pages written afterwards: copied, or reused as the last PTE left */
+static atomic_ulong cow_forks, cow_shared, cow_private;
+static atomic_ulong cow_copied, cow_reused;
+
+/* Swap devices by swap type, NULL or empty ones are never used */
+struct swap_dev_t {
+  struct memphy_struct *mp;
+  atomic_ulong pages_out, pages_in;
+};
+static struct swap_dev_t swap_devs[PAGING_MAX_MMSWP];
+static enum swap_place_t swap_place = SWAP_PLACE_STRIPE;
+static const char *swap_place_names[] = { "stripe", "free", "tier" };
+static int swap_next; /* Next device to stripe on */
+
+/* Fault service statistics, times in thousandths of a slot */
+static atomic_ulong fault_count, fault_cost, fault_free;
+static atomic_ulong fault_max;
+
+/* kswapd, watermarks of 0 are derived from the size of MEMRAM */
+static int kswapd_on;
+static int kswapd_low, kswapd_high;
+static atomic_ulong kswapd_wakeups, kswapd_pages;
+
+void reclaim_lock(void)
+{
+  pthread_mutex_lock(&reclaim_mtx);
+}
+
+void reclaim_unlock(void)
+{
+  pthread_mutex_unlock(&reclaim_mtx);
+}
+
+void mm_lock(struct mm_struct *mm)
+{
+  pthread_mutex_lock(&mm->lock);
+}
+
+void mm_unlock(struct mm_struct *mm)
+{
+  pthread_mutex_unlock(&mm->lock);
+}
+
+/*
+ *  reclaim_register_mm - make the frames of an mm reclaimable
+ *  @mm: new mm
+ *  @caller: mm owner
+ */
+void reclaim_register_mm(struct mm_struct *mm, struct pcb_t *caller)
+{
+  mm->pid = caller->pid;
+  mm->rss_peak = 0;
+  atomic_init(&mm->tlb_gen, 0);
+  pthread_mutex_init(&mm->lock, NULL);
+
+  reclaim_lock();
+  mm->mm_prev = NULL;
+  mm->mm_next = mm_list;
+  if (mm_list != NULL)
+    mm_list->mm_prev = mm;
+  mm_list = mm;
+  reclaim_unlock();
+}
+
+/*
+ *  reclaim_unregister_mm - forget an mm, the caller holds the lock
+ *  @mm: mm going away
+ */
+void reclaim_unregister_mm(struct mm_struct *mm)
+{
+  if (mm->mm_prev != NULL)
+    mm->mm_prev->mm_next = mm->mm_next;
+  else if (mm_list == mm)
+    mm_list = mm->mm_next;
+  if (mm->mm_next != NULL)
+    mm->mm_next->mm_prev = mm->mm_prev;
+  mm->mm_prev = mm->mm_next = NULL;
+}
+
+/* The mm holding the most MEMRAM frames, [self] on a tie. The resident
+ * set sizes are read without the locks of the mm */
+static struct mm_struct *reclaim_victim_mm(struct mm_struct *self)
+{
+  struct mm_struct *mm, *victim = self;
+
+  for (mm = mm_list; mm != NULL; mm = mm->mm_next)
+  {
+    if (victim == NULL || mm->pgrepl.count > victim->pgrepl.count)
+      victim = mm;
+  }
+  return (victim != NULL && victim->pgrepl.count > 0) ? victim : NULL;
+}
+
+/*
+ *  reclaim_set_swap - use a MEMSWP device for the swap type
+ *  @swptyp: swap type, index of the device
+ *  @mp: device, a 0 sized one is left unused
+ */
+int reclaim_set_swap(int swptyp, struct memphy_struct *mp)
+{
+  if (swptyp < 0 || swptyp >= PAGING_MAX_MMSWP)
+    return -1;
+  swap_devs[swptyp].mp = mp;
+  return 0;
+}
+
+/*
+ *  reclaim_set_swap_place - select where evicted pages are placed
+ *  @place: placement policy
+ */
+int reclaim_set_swap_place(enum swap_place_t place)
+{
+  swap_place = place;
+  return 0;
+}
+
+/* Device of a swap type. Until devices are set, the active swap device
+ * of the first caller is the only one */
+static struct memphy_struct *swap_dev(struct pcb_t *caller, int swptyp)
+{
+  if (swap_devs[0].mp == NULL && caller != NULL)
+    swap_devs[0].mp = caller->active_mswp;
+  return swap_devs[swptyp].mp;
+}
+
+static int swap_nr_free(int swptyp)
+{
+  struct memphy_struct *mp = swap_devs[swptyp].mp;
+  return (mp != NULL) ? mp->nr_free : 0;
+}
+
+/* Get a swap frame on the device the placement policy picks, another
+ * one if that one is full. Return its swap type or -1 */
+static int swap_get_freefp(int *swpfpn)
+{
+  int i, typ, best = -1;
+
+  switch (swap_place)
+  {
+  case SWAP_PLACE_FREE:
+    for (typ = 0; typ < PAGING_MAX_MMSWP; typ++)
+    {
+      if (swap_nr_free(typ) > 0 &&
+          (best < 0 || swap_nr_free(typ) > swap_nr_free(best)))
+        best = typ;
+    }
+    break;
+  case SWAP_PLACE_TIER:
+    for (typ = 0; typ < PAGING_MAX_MMSWP; typ++)
+    {
+      if (swap_nr_free(typ) > 0 &&
+          (best < 0 || MEMPHY_cost(swap_devs[typ].mp, PAGING_PAGESZ) <
+                       MEMPHY_cost(swap_devs[best].mp, PAGING_PAGESZ)))
+        best = typ;
+    }
+    break;
+  default:
+    for (i = 0; i < PAGING_MAX_MMSWP && best < 0; i++)
+    {
+      typ = (swap_next + i) % PAGING_MAX_MMSWP;
+      if (swap_nr_free(typ) > 0)
+        best = typ;
+    }
+    if (best >= 0)
+      swap_next = (best + 1) % PAGING_MAX_MMSWP;
+    break;
+  }
+
+  if (best < 0 || MEMPHY_get_freefp(swap_devs[best].mp, swpfpn) < 0)
+    return -1;
+  return best;
+}
+
+/* Drop a PTE's reference on a MEMRAM frame, the last one frees the
+ * frame and its swap copy. Return 1 if the frame was freed */
+static int reclaim_put_frame(struct memphy_struct *mram, int fpn)
+{
+  struct framephy_struct *fp = &mram->fp_tbl[fpn];
+
+  if (atomic_fetch_sub(&fp->refs, 1) > 1)
+    return 0;
+  if (fp->swpoff >= 0)
+    MEMPHY_put_freefp(swap_devs[fp->swptyp].mp, fp->swpoff);
+  MEMPHY_put_freefp(mram, fpn);
+  return 1;
+}
+
+/* Swap a page of the mm holding the most frames out. A clean page whose
+ * swap copy is still valid is dropped without a copy, a dirty one is
+ * written back over its copy. A page shared copy-on-write is copied to
+ * a swap frame of its own and the next page is tried while another PTE
+ * keeps its frame. Return the frame it used, still allocated and owned
+ * by nobody, or -1. The caller holds the reclaim lock */
+static int reclaim_evict(struct memphy_struct *mram, struct mm_struct *self)
+{
+  struct mm_struct *vmm;
+  int vicpgn, vicfpn, swptyp, swpfpn, shared;
+  uint32_t *pte;
+
+  for (;;)
+  {
+    vmm = reclaim_victim_mm(self);
+    if (vmm == NULL)
+      return -1;
+    mm_lock(vmm);
+    if (find_victim_page(vmm, &vicpgn) < 0)
+    {
+      mm_unlock(vmm);
+      return -1;
+    }
+    pte = pte_get(vmm, vicpgn);
+    vicfpn = PAGING_PTE_FPN(*pte);
+    shared = (*pte & PAGING_PTE_COW_MASK) && mram->fp_tbl[vicfpn].refs > 1;
+    swptyp = mram->fp_tbl[vicfpn].swptyp;
+    swpfpn = shared ? -1 : mram->fp_tbl[vicfpn].swpoff;
+
+    if (swpfpn >= 0 && !(*pte & PAGING_PTE_DIRTY_MASK))
+      atomic_fetch_add(&reclaim_clean, 1);
+    else
+    {
+      if (swpfpn < 0 && (swptyp = swap_get_freefp(&swpfpn)) < 0)
+      {
+        pgrepl_add(vmm, vicpgn); /* Swap is full, the page stays */
+        mm_unlock(vmm);
+        return -1;
+      }
+
+      /* Copy victim frame to swap */
+      __swap_cp_page(mram, vicfpn, swap_devs[swptyp].mp, swpfpn);
+      atomic_fetch_add(&swap_devs[swptyp].pages_out, 1);
+      atomic_fetch_add(&reclaim_written, 1);
+    }
+
+    /* Update the page table of the victim */
+    pte_set_swap(pte, swptyp, swpfpn);
+
+    /* The victim may be running on another CPU, its referenced bits were
+     * cleared too while picking the page */
+    if (vmm != self)
+    {
+      tlb_shootdown(vmm);
+      if (self != NULL)
+        atomic_fetch_add(&reclaim_stolen, 1);
+    }
+
+    if (shared)
+    { /* The other PTEs may have let go of the frame since */
+      if (atomic_fetch_sub(&mram->fp_tbl[vicfpn].refs, 1) > 1)
+      {
+        mm_unlock(vmm);
+        continue;
+      }
+      atomic_store(&mram->fp_tbl[vicfpn].refs, 1);
+      if (mram->fp_tbl[vicfpn].swpoff >= 0)
+        MEMPHY_put_freefp(swap_devs[mram->fp_tbl[vicfpn].swptyp].mp,
+                          mram->fp_tbl[vicfpn].swpoff);
+    }
+
+    MEMPHY_set_owner(mram, vicfpn, NULL, -1);
+    mram->fp_tbl[vicfpn].swpoff = -1;
+    mm_unlock(vmm);
+    return vicfpn;
+  }
+}
+
+/*
+ *  reclaim_get_frame - get a MEMRAM frame for the caller, the caller
+ *                      holds no lock
+ *  @caller: caller
+ *  @fpn: return frame, owned by the caller and not mapped yet
+ *
+ *  A free frame is used first. Otherwise a page of the mm holding the
+ *  most frames is evicted to swap.
+ *  Return the time taken writing a page to swap, in MEMPHY_COST_UNIT,
+ *  -1 if there is no frame
+ */
+int reclaim_get_frame(struct pcb_t *caller, int *retfpn)
+{
+  uint64_t start = MEMPHY_charged();
+
+  if (MEMPHY_get_freefp(caller->mram, retfpn) < 0)
+  {
+    reclaim_lock();
+    /* A frame may have been freed while waiting */
+    if (MEMPHY_get_freefp(caller->mram, retfpn) < 0)
+    {
+      swap_dev(caller, 0);
+      *retfpn = reclaim_evict(caller->mram, caller->mm);
+    }
+    reclaim_unlock();
+    if (*retfpn < 0)
+      return -1;
+  }
+  MEMPHY_set_owner(caller->mram, *retfpn, caller->mm, -1);
+  return MEMPHY_charged() - start;
+}
+
+/*
+ *  reclaim_swap_in - copy a swapped page into a frame of the caller, the
+ *                    caller holds the lock of its mm
+ *  @caller: caller
+ *  @pte: PTE of the swapped page
+ *  @fpn: frame the page goes to, it keeps the swap copy
+ *  Return the time the transfer took, in MEMPHY_COST_UNIT
+ */
+int reclaim_swap_in(struct pcb_t *caller, uint32_t pte, int fpn)
+{
+  int swptyp = PAGING_PTE_SWPTYP(pte);
+  int swpfpn = PAGING_PTE_SWP(pte);
+  uint64_t start = MEMPHY_charged();
+
+  __swap_cp_page(swap_dev(caller, swptyp), swpfpn, caller->mram, fpn);
+  caller->mram->fp_tbl[fpn].swptyp = swptyp;
+  caller->mram->fp_tbl[fpn].swpoff = swpfpn;
+  atomic_fetch_add(&swap_devs[swptyp].pages_in, 1);
+  return MEMPHY_charged() - start;
+}
+
+/*
+ *  reclaim_fault - account a page fault serviced by the calling CPU, the
+ *                  device accesses already charged it the time
+ *  @in_cost: time taken to bring the page in
+ *  @out_cost: time taken to write a victim back, 0 if none
+ */
+void reclaim_fault(uint64_t in_cost, uint64_t out_cost)
+{
+  unsigned long cost = in_cost + out_cost;
+  unsigned long max = atomic_load(&fault_max);
+
+  atomic_fetch_add(&fault_count, 1);
+  atomic_fetch_add(&fault_cost, cost);
+  if (out_cost == 0)
+    atomic_fetch_add(&fault_free, 1);
+  while (cost > max && !atomic_compare_exchange_weak(&fault_max, &max, cost))
+    ;
+}
+
+/*
+ *  kswapd_set_watermarks - enable the page-out daemon
+ *  @low: free frames below which it wakes up, 0 for MEMRAM / 16
+ *  @high: free frames it stops at, 0 for twice the low one
+ */
+int kswapd_set_watermarks(int low, int high)
+{
+  if (low < 0 || high < 0 || (high != 0 && high <= low))
+    return -1;
+
+  kswapd_on = 1;
+  kswapd_low = low;
+  kswapd_high = high;
+  return 0;
+}
+
+int kswapd_enabled(void)
+{
+  return kswapd_on;
+}
+
+/*
+ *  kswapd_balance - page out until MEMRAM has [high] free frames, if it
+ *                   has fewer than [low]
+ *  @mram: MEMRAM
+ *  Return the number of slots the page-outs took
+ */
+int kswapd_balance(struct memphy_struct *mram)
+{
+  int fpn, pages = 0;
+
+  if (kswapd_low == 0)
+  {
+    kswapd_low = (mram->numfp / 16 > 0) ? mram->numfp / 16 : 1;
+    if (kswapd_high <= kswapd_low)
+      kswapd_high = 2 * kswapd_low;
+  }
+
+  /* Unlocked peek, nothing to do most of the slots */
+  if (mram->nr_free >= kswapd_low)
+    return MEMPHY_take_stall();
+
+  reclaim_lock();
+  if (mram->nr_free < kswapd_low)
+  {
+    atomic_fetch_add(&kswapd_wakeups, 1);
+    while (mram->nr_free < kswapd_high &&
+           (fpn = reclaim_evict(mram, NULL)) >= 0)
+    {
+      MEMPHY_put_freefp(mram, fpn);
+      pages++;
+    }
+  }
+  reclaim_unlock();
+
+  atomic_fetch_add(&kswapd_pages, pages);
+  return MEMPHY_take_stall();
+}
+
+/*
+ *  free_pcb_memph - give back every frame of a finished process
+ *  @caller: caller
+ *  Return the number of MEMRAM frames it held
+ */
+int free_pcb_memph(struct pcb_t *caller)
+{
+  struct memphy_struct *mram = caller->mram;
+  struct mm_struct *mm = caller->mm;
+  int pagenum, fpn, rss = 0;
+  uint32_t pte;
+
+  /* Once unregistered, no eviction reaches the mm any more */
+  reclaim_lock();
+  reclaim_unregister_mm(mm);
+  reclaim_unlock();
+
+  for (pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
+  {
+    if (mm->pgd[PAGING_PGD_IDX(pagenum)] == NULL)
+    { /* Skip the page tables never allocated */
+      pagenum |= PAGING_PT_ENTRIES - 1;
+      continue;
+    }
+    pte = *pte_get(mm, pagenum);
+    if (!PAGING_PAGE_PRESENT(pte))
+      continue;
+    if (PAGING_PAGE_SWAPPED(pte))
+    {
+      MEMPHY_put_freefp(swap_dev(caller, PAGING_PTE_SWPTYP(pte)),
+                        PAGING_PTE_SWP(pte));
+      continue;
+    }
+    /* A frame in MEMRAM and the swap copy it may keep, unless the frame
+     * is still shared with another process */
+    fpn = PAGING_PTE_FPN(pte);
+    if (reclaim_put_frame(mram, fpn))
+      rss++;
+  }
+
+  atomic_fetch_add(&reclaim_exited, rss);
+  return rss;
+}
+
+/*
+ *  reclaim_fork_pages - map the pages of a forking process in its child
+ *  @parent: forking process
+ *  @child: new process, its mm has no page mapped yet
+ *
+ *  The pages in MEMRAM are shared copy-on-write. A swapped page or a
+ *  page of a huge mapping is copied to a frame of the child, a free
+ *  MEMRAM frame if any, else a swap frame.
+ *  Return -1 if no frame is left, the pages mapped so far stay mapped
+ */
+int reclaim_fork_pages(struct pcb_t *parent, struct pcb_t *child)
+{
+  struct memphy_struct *mram = parent->mram;
+  struct mm_struct *mm = parent->mm, *cmm = child->mm;
+  int pgn, fpn, swptyp, swpfpn, err = 0;
+  unsigned long shared = 0, private = 0;
+  uint32_t pte, *cpte;
+
+  /* No eviction changes either page table meanwhile */
+  reclaim_lock();
+  swap_dev(parent, 0);
+  mm_lock(mm);
+  mm_lock(cmm);
+  for (pgn = 0; pgn < PAGING_MAX_PGN && err == 0; pgn++)
+  {
+    if (mm->pgd[PAGING_PGD_IDX(pgn)] == NULL)
+    {
+      pgn |= PAGING_PT_ENTRIES - 1;
+      continue;
+    }
+    pte = *pte_get(mm, pgn);
+    if (!PAGING_PAGE_PRESENT(pte))
+      continue;
+    cpte = pte_alloc(cmm, pgn);
+    if (cpte == NULL)
+    {
+      err = -1;
+      break;
+    }
+
+    if (PAGING_PAGE_IN_RAM(pte) && !(pte & PAGING_PTE_HUGE_MASK))
+    { /* Write protect both PTEs, the TLBs only serve the reads */
+      fpn = PAGING_PTE_FPN(pte);
+      SETBIT(*pte_get(mm, pgn), PAGING_PTE_COW_MASK);
+      atomic_fetch_add(&mram->fp_tbl[fpn].refs, 1);
+      *cpte = (pte | PAGING_PTE_COW_MASK) & ~PAGING_PTE_REFERENCED_MASK;
+      pgrepl_add(cmm, pgn);
+      shared++;
+      continue;
+    }
+
+    /* Where the data is now */
+    if (PAGING_PAGE_SWAPPED(pte))
+    {
+      swptyp = PAGING_PTE_SWPTYP(pte);
+      swpfpn = PAGING_PTE_SWP(pte);
+    }
+
+    if (MEMPHY_get_freefp(mram, &fpn) == 0)
+    {
+      if (PAGING_PAGE_SWAPPED(pte))
+        __swap_cp_page(swap_devs[swptyp].mp, swpfpn, mram, fpn);
+      else
+        __swap_cp_page(mram, PAGING_PTE_FPN(pte), mram, fpn);
+      pte_set_fpn(cpte, fpn);
+      MEMPHY_set_owner(mram, fpn, cmm, pgn);
+      pgrepl_add(cmm, pgn);
+    }
+    else
+    {
+      int typ = swap_get_freefp(&fpn);
+      if (typ < 0)
+      {
+        err = -1;
+        break;
+      }
+      if (PAGING_PAGE_SWAPPED(pte))
+        __swap_cp_page(swap_devs[swptyp].mp, swpfpn, swap_devs[typ].mp, fpn);
+      else
+        __swap_cp_page(mram, PAGING_PTE_FPN(pte), swap_devs[typ].mp, fpn);
+      pte_set_swap(cpte, typ, fpn);
+    }
+    private++;
+  }
+  mm_unlock(cmm);
+  mm_unlock(mm);
+  reclaim_unlock();
+
+  atomic_fetch_add(&cow_shared, shared);
+  atomic_fetch_add(&cow_private, private);
+  if (err == 0)
+    atomic_fetch_add(&cow_forks, 1);
+  return err;
+}
+
+/*
+ *  reclaim_cow_break - make a copy-on-write page writable, the caller
+ *                      holds the lock of its mm
+ *  @caller: caller
+ *  @pgn: page in MEMRAM whose PTE has the COW bit
+ *  @fpn: return the frame to write to
+ *
+ *  The frame is copied unless no other PTE maps it any more. The lock of
+ *  the mm is dropped while getting a frame: return 1 if the page was
+ *  evicted meanwhile, to be brought in again, -1 if no frame is left
+ */
+int reclaim_cow_break(struct pcb_t *caller, int pgn, int *fpn)
+{
+  struct memphy_struct *mram = caller->mram;
+  struct mm_struct *mm = caller->mm;
+  uint32_t *pte = pte_get(mm, pgn);
+  int oldfpn = PAGING_PTE_FPN(*pte), newfpn;
+
+  if (mram->fp_tbl[oldfpn].refs == 1)
+  { /* Last PTE of the frame, the other ones were written or freed */
+    CLRBIT(*pte, PAGING_PTE_COW_MASK);
+    atomic_fetch_add(&cow_reused, 1);
+    *fpn = oldfpn;
+    return 0;
+  }
+
+  mm_unlock(mm);
+  if (reclaim_get_frame(caller, &newfpn) < 0)
+  {
+    mm_lock(mm);
+    return -1;
+  }
+  mm_lock(mm);
+
+  if (!PAGING_PAGE_IN_RAM(*pte) || !(*pte & PAGING_PTE_COW_MASK))
+  { /* Evicted meanwhile */
+    MEMPHY_put_freefp(mram, newfpn);
+    return 1;
+  }
+
+  oldfpn = PAGING_PTE_FPN(*pte);
+  MEMPHY_cp_frame(mram, oldfpn, mram, newfpn, PAGING_PAGESZ);
+  pte_set_fpn(pte, newfpn);
+  MEMPHY_set_owner(mram, newfpn, mm, pgn);
+  reclaim_put_frame(mram, oldfpn);
+  atomic_fetch_add(&cow_copied, 1);
+  *fpn = newfpn;
+  return 0;
+}
+
+/*
+ *  reclaim_get_stats - page faults serviced and frames taken from
+ *                      another process so far
+ *  Any of the outputs may be NULL
+ */
+void reclaim_get_stats(unsigned long *faults, unsigned long *stolen)
+{
+  if (faults)
+    *faults = atomic_load(&fault_count);
+  if (stolen)
+    *stolen = atomic_load(&reclaim_stolen);
+}
+
+/*
+ *  reclaim_report - print the frames moved between processes and the
+ *                   resident set of the processes still registered
+ */
+void reclaim_report(void)
+{
+  struct mm_struct *mm;
+  unsigned long faults = atomic_load(&fault_count);
+  char name[16];
+  int typ;
+
+  printf("Frame reclaim: %lu frames taken from other processes,"
+         " %lu freed by finished processes\n",
+         atomic_load(&reclaim_stolen), atomic_load(&reclaim_exited));
+  printf("Fault service: %lu faults,"
+         " %.2f slots on average, %.2f at most, %.1f%% without a write-back\n",
+         faults,
+         faults ? (double)atomic_load(&fault_cost) / faults /
+                  MEMPHY_COST_UNIT : 0.0,
+         (double)atomic_load(&fault_max) / MEMPHY_COST_UNIT,
+         faults ? 100.0 * atomic_load(&fault_free) / faults : 0.0);
+  printf("Write-back: %lu evicted pages copied to swap, %lu clean pages"
+         " dropped without a copy\n", atomic_load(&reclaim_written),
+         atomic_load(&reclaim_clean));
+  for (typ = 0; typ < PAGING_MAX_MMSWP; typ++)
+  {
+    struct memphy_struct *mp = swap_devs[typ].mp;
+    if (mp == NULL || mp->numfp == 0)
+      continue;
+    printf("\tSwap %d (%s, %d frames, %.2f slots per page): %lu pages out,"
+           " %lu pages in, %d frames in use\n", typ,
+           swap_place_names[swap_place], mp->numfp,
+           (double)MEMPHY_cost(mp, PAGING_PAGESZ) / MEMPHY_COST_UNIT,
+           atomic_load(&swap_devs[typ].pages_out),
+           atomic_load(&swap_devs[typ].pages_in), mp->numfp - mp->nr_free);
+    snprintf(name, sizeof(name), "Swap %d", typ);
+    MEMPHY_report(mp, name);
+  }
+  if (atomic_load(&cow_forks) > 0)
+    printf("Copy-on-write: %lu forks, %lu pages shared and %lu copied at"
+           " the fork, %lu shared pages copied on a write, %lu reused\n",
+           atomic_load(&cow_forks), atomic_load(&cow_shared),
+           atomic_load(&cow_private), atomic_load(&cow_copied),
+           atomic_load(&cow_reused));
+  if (kswapd_on)
+    printf("kswapd (watermarks %d/%d frames): %lu wakeups,"
+           " %lu pages paged out\n", kswapd_low, kswapd_high,
+           atomic_load(&kswapd_wakeups), atomic_load(&kswapd_pages));
+
+  reclaim_lock();
+  for (mm = mm_list; mm != NULL; mm = mm->mm_next)
+    printf("\tPID %2d: RSS %d frames (peak %d), page table %d bytes\n",
+           mm->pid, mm->pgrepl.count, mm->rss_peak, mm_pgtable_bytes(mm));
+  reclaim_unlock();
+}
+
+//#endif
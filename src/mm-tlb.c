@@ -0,0 +1,282 @@
+//#ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Software TLB module mm/mm-tlb.c
+ *
+ * Each CPU owns a set-associative TLB caching page translations. An
+ * entry is tagged with the address of its PTE, which is unique over all
+ * the page tables, so no address space id is needed. A CPU flushes its
+ * TLB when it dispatches a process. The invalidation done by
+ * pte_set_fpn() and pte_set_swap() only reaches the TLB of the calling
+ * CPU, a CPU changing the PTEs of another mm shoots the TLBs of that mm
+ * down with tlb_shootdown()
+ */
+
+#include "mm.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+struct tlb_entry_t {
+  uint32_t *pte;   /* Tag, NULL when the entry is invalid */
+  int fpn;
+  uint32_t stamp;  /* Last use, the least recent way is replaced */
+};
+
+struct tlb_struct {
+  struct tlb_entry_t *entry; /* nsets * ways entries, set by set */
+  uint32_t setmask;
+  uint32_t tick;
+  struct mm_struct *mm; /* mm being run and its tlb_gen seen last */
+  unsigned int gen;
+  unsigned long hits, misses, flushes, invals;
+};
+
+static int tlb_entries = TLB_DEFAULT_ENTRIES;
+static int tlb_ways = TLB_DEFAULT_WAYS;
+
+/* Counters of the detached TLBs */
+static atomic_ulong tlb_hits, tlb_misses, tlb_flushes, tlb_invals;
+
+static _Thread_local struct tlb_struct *cpu_tlb;
+
+/*
+ *  tlb_set_geometry - size the TLBs attached from now on
+ *  @entries: number of entries, 0 disables the TLB
+ *  @ways: associativity, entries / ways sets
+ */
+int tlb_set_geometry(int entries, int ways)
+{
+  int nsets;
+
+  if (entries == 0) {
+    tlb_entries = 0;
+    return 0;
+  }
+  if (entries < 0 || ways <= 0 || entries % ways)
+    return -1;
+
+  nsets = entries / ways;
+  if (nsets & (nsets - 1))
+    return -1; /* The set is picked by masking */
+
+  tlb_entries = entries;
+  tlb_ways = ways;
+  return 0;
+}
+
+/*
+ *  tlb_attach_cpu - give the calling CPU thread its TLB
+ */
+int tlb_attach_cpu(void)
+{
+  struct tlb_struct *tlb;
+
+  if (tlb_entries == 0)
+    return 0;
+
+  tlb = malloc(sizeof(struct tlb_struct));
+  if (tlb == NULL)
+    return -1;
+  tlb->entry = calloc(tlb_entries, sizeof(struct tlb_entry_t));
+  if (tlb->entry == NULL) {
+    free(tlb);
+    return -1;
+  }
+  tlb->setmask = tlb_entries / tlb_ways - 1;
+  tlb->tick = 0;
+  tlb->mm = NULL;
+  tlb->gen = 0;
+  tlb->hits = tlb->misses = tlb->flushes = tlb->invals = 0;
+  cpu_tlb = tlb;
+  return 0;
+}
+
+/*
+ *  tlb_detach_cpu - release the TLB of the calling CPU thread
+ */
+void tlb_detach_cpu(void)
+{
+  struct tlb_struct *tlb = cpu_tlb;
+
+  if (tlb == NULL)
+    return;
+
+  atomic_fetch_add(&tlb_hits, tlb->hits);
+  atomic_fetch_add(&tlb_misses, tlb->misses);
+  atomic_fetch_add(&tlb_flushes, tlb->flushes);
+  atomic_fetch_add(&tlb_invals, tlb->invals);
+  cpu_tlb = NULL;
+  free(tlb->entry);
+  free(tlb);
+}
+
+static struct tlb_entry_t *tlb_set(struct tlb_struct *tlb, uint32_t *pte)
+{
+  uint32_t set = ((uintptr_t)pte / sizeof(uint32_t)) & tlb->setmask;
+  return &tlb->entry[set * tlb_ways];
+}
+
+/*
+ *  tlb_lookup - translate through the TLB of the calling CPU
+ *  @pte: PTE of the page
+ *  @fpn: returned FPN on a hit
+ *  Return 0 on a hit
+ */
+int tlb_lookup(uint32_t *pte, int *fpn)
+{
+  struct tlb_struct *tlb = cpu_tlb;
+  struct tlb_entry_t *e;
+  int way;
+
+  if (tlb == NULL)
+    return -1;
+
+  if (tlb->mm != NULL &&
+      atomic_load_explicit(&tlb->mm->tlb_gen, memory_order_acquire) != tlb->gen)
+    tlb_switch_mm(tlb->mm); /* Shot down */
+
+  e = tlb_set(tlb, pte);
+  for (way = 0; way < tlb_ways; way++) {
+    if (e[way].pte == pte) {
+      e[way].stamp = ++tlb->tick;
+      *fpn = e[way].fpn;
+      tlb->hits++;
+      return 0;
+    }
+  }
+  tlb->misses++;
+  return -1;
+}
+
+/*
+ *  tlb_insert - cache the translation of a page in RAM
+ *  @pte: PTE of the page
+ *  @fpn: its FPN
+ */
+void tlb_insert(uint32_t *pte, int fpn)
+{
+  struct tlb_struct *tlb = cpu_tlb;
+  struct tlb_entry_t *e, *victim;
+  int way;
+
+  if (tlb == NULL)
+    return;
+
+  e = tlb_set(tlb, pte);
+  victim = &e[0];
+  for (way = 0; way < tlb_ways; way++) {
+    if (e[way].pte == pte || e[way].pte == NULL) {
+      victim = &e[way];
+      break;
+    }
+    if (e[way].stamp < victim->stamp)
+      victim = &e[way];
+  }
+  victim->pte = pte;
+  victim->fpn = fpn;
+  victim->stamp = ++tlb->tick;
+}
+
+/*
+ *  tlb_invalidate - drop the translation of a PTE being changed
+ *  @pte: PTE of the page
+ */
+void tlb_invalidate(uint32_t *pte)
+{
+  struct tlb_struct *tlb = cpu_tlb;
+  struct tlb_entry_t *e;
+  int way;
+
+  if (tlb == NULL)
+    return;
+
+  e = tlb_set(tlb, pte);
+  for (way = 0; way < tlb_ways; way++) {
+    if (e[way].pte == pte) {
+      e[way].pte = NULL;
+      tlb->invals++;
+    }
+  }
+}
+
+/*
+ *  tlb_flush - drop every translation of the calling CPU
+ */
+void tlb_flush(void)
+{
+  struct tlb_struct *tlb = cpu_tlb;
+  int i;
+
+  if (tlb == NULL)
+    return;
+
+  for (i = 0; i < tlb_entries; i++)
+    tlb->entry[i].pte = NULL;
+  tlb->flushes++;
+}
+
+/*
+ *  tlb_switch_mm - flush the TLB of the calling CPU for the mm it runs
+ *  @mm: mm dispatched, its shootdowns flush the TLB again
+ */
+void tlb_switch_mm(struct mm_struct *mm)
+{
+  struct tlb_struct *tlb = cpu_tlb;
+
+  if (tlb == NULL)
+    return;
+
+  tlb->mm = mm;
+  if (mm != NULL)
+    tlb->gen = atomic_load_explicit(&mm->tlb_gen, memory_order_acquire);
+  tlb_flush();
+}
+
+/*
+ *  tlb_shootdown - drop the translations of an mm from every TLB
+ *  @mm: mm whose PTEs were changed by another CPU
+ *
+ *  The CPU running the mm flushes its TLB at its next lookup
+ */
+void tlb_shootdown(struct mm_struct *mm)
+{
+  atomic_fetch_add_explicit(&mm->tlb_gen, 1, memory_order_release);
+}
+
+/*
+ *  tlb_get_stats - sum the counters of the detached TLBs
+ *  Any of the outputs may be NULL
+ */
+void tlb_get_stats(unsigned long *hits, unsigned long *misses,
+                   unsigned long *flushes, unsigned long *invals)
+{
+  if (hits)
+    *hits = atomic_load(&tlb_hits);
+  if (misses)
+    *misses = atomic_load(&tlb_misses);
+  if (flushes)
+    *flushes = atomic_load(&tlb_flushes);
+  if (invals)
+    *invals = atomic_load(&tlb_invals);
+}
+
+/*
+ *  tlb_report - print the counters of the detached TLBs
+ */
+void tlb_report(void)
+{
+  unsigned long hits, misses, flushes, invals;
+
+  if (tlb_entries == 0)
+    return;
+
+  tlb_get_stats(&hits, &misses, &flushes, &invals);
+  printf("TLB (%d entries, %d-way per CPU): hits %lu misses %lu"
+         " (%.1f%% hit) flushes %lu invalidations %lu\n",
+         tlb_entries, tlb_ways, hits, misses,
+         (hits + misses) ? 100.0 * hits / (hits + misses) : 0.0,
+         flushes, invals);
+}
+
+//#endif
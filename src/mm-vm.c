@@ -8,6 +8,18 @@
 #include "mm.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Page replacement, the victim page in the mm picked by the global
+ * reclaimer is chosen by the policy selected with pgrepl_set_policy()
+ */
+static enum pgrepl_policy_t pgrepl_policy = PGREPL_FIFO;
+static const char *pgrepl_names[] = { "fifo", "clock", "lru", "opt" };
+static atomic_ulong pgrepl_faults;
+static atomic_ulong pgrepl_zero_faults;
+static atomic_ulong pgrepl_evictions;
 
 /*enlist_vm_freerg_list - add new rg to freerg_list
  *@mm: memory region
@@ -22,9 +34,12 @@ int enlist_vm_freerg_list(struct mm_struct *mm, struct vm_rg_struct rg_elmt)
   new_rg->rg_end = rg_elmt.rg_end;
 
   if (rg_elmt.rg_start >= rg_elmt.rg_end)
+  {
+    free(new_rg);
     return -1;
+  }
 
-  if (rg_node != NULL) new_rg->rg_next = rg_node;
+  new_rg->rg_next = rg_node;
 
   /* Enlist the new region */
   mm->mmap->vm_freerg_list = new_rg;
@@ -99,12 +114,26 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
   //int inc_limit_ret
   int old_sbrk, old_end; //OK
 
+  /* A region of a huge page or more starts on a huge page boundary, so
+   * its first access can map a huge page, the pages skipped are left
+   * free for smaller regions */
+  int huge_sz = paging_huge_pgnum * PAGING_PAGESZ;
+  if (huge_sz && size >= huge_sz && cur_vma->vm_end % huge_sz)
+  {
+    struct vm_rg_struct pad_rg;
+    pad_rg.rg_start = cur_vma->vm_end;
+    pad_rg.rg_end = cur_vma->vm_end + huge_sz - cur_vma->vm_end % huge_sz;
+    if (inc_vma_limit(caller, vmaid, pad_rg.rg_end - pad_rg.rg_start) == 0)
+      enlist_vm_freerg_list(caller->mm, pad_rg);
+  }
+
   old_sbrk = cur_vma->sbrk; //OK
 	old_end = cur_vma->vm_end;
   /* TODO INCREASE THE LIMIT
    * inc_vma_limit(caller, vmaid, inc_sz)
    */
-  inc_vma_limit(caller, vmaid, inc_sz); //OK
+  if (inc_vma_limit(caller, vmaid, inc_sz) < 0)
+    return -1; /* Out of virtual address space */
 
   /*Successful increase limit */
   struct vm_rg_struct new_free_rg;
@@ -164,53 +193,161 @@ int pgfree_data(struct pcb_t *proc, uint32_t reg_index)
    return __free(proc, 0, reg_index);
 }
 
-/*pg_getpage - get the page in ram
- *@mm: memory region
+/*pg_gethuge - get a page of a huge mapping, always in ram
+ *@ptep: PTE of the page
  *@pagenum: PGN
  *@framenum: return FPN
+ *
+ *The frames of a huge page are contiguous, a single TLB entry tagged
+ *with the PTE of its first page translates all of its pages
+ */
+static int pg_gethuge(uint32_t *ptep, int pgn, int *fpn)
+{
+  int sub = pgn & (paging_huge_pgnum - 1);
+  uint32_t *head = ptep - sub;
+
+  if (tlb_lookup(head, fpn) != 0)
+  {
+    *fpn = PAGING_PTE_FPN(*head);
+    tlb_insert(head, *fpn);
+  }
+  *fpn += sub;
+  return 0;
+}
+
+/* A huge page backs the run of pages around pgn when the run lies in a
+ * single region, ie in a large ALLOC, and none of its pages is mapped */
+static int pg_huge_fits(struct mm_struct *mm, int pgn)
+{
+  int head = pgn & ~(paging_huge_pgnum - 1);
+  unsigned long start = (unsigned long)head << PAGING_ADDR_PGN_LOBIT;
+  unsigned long end = start + paging_huge_pgnum * PAGING_PAGESZ;
+  uint32_t *pte = pte_get(mm, head);
+  int i;
+
+  for (i = 0; i < PAGING_MAX_SYMTBL_SZ; i++)
+    if (mm->symrgtbl[i].rg_start <= start && end <= mm->symrgtbl[i].rg_end)
+      break;
+  if (i == PAGING_MAX_SYMTBL_SZ)
+    return 0;
+
+  for (i = 0; pte != NULL && i < paging_huge_pgnum; i++)
+    if (pte[i] != 0)
+      return 0;
+  return 1;
+}
+
+/*pg_demand_zero - back a page on its first access with a zeroed frame,
+ *                 the caller holds the lock of the mm
+ *@mm: memory region
+ *@pagenum: PGN
  *@caller: caller
  *
+ *ALLOC only reserves the virtual space: a page of a vm area whose PTE
+ *is not present has never been touched. Return its PTE, NULL if the
+ *page lies out of every vm area or no frame is left
  */
-int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
+static uint32_t *pg_demand_zero(struct mm_struct *mm, int pgn,
+                                struct pcb_t *caller)
 {
-  uint32_t pte = mm->pgd[pgn];
-  if (!PAGING_PAGE_PRESENT(pte))
-  { /* Page is not online, make it actively living */
-    int vicpgn, swpfpn; 
-    //uint32_t vicpte;
+  unsigned long addr = (unsigned long)pgn << PAGING_ADDR_PGN_LOBIT;
+  struct vm_area_struct *vma;
+  uint32_t *ptep;
+  int fpn;
 
-    int tgtfpn = PAGING_SWP(pte);//the target frame storing our variable
+  for (vma = mm->mmap; vma != NULL; vma = vma->vm_next)
+    if (vma->vm_start <= addr && addr < vma->vm_end)
+      break;
+  if (vma == NULL)
+    return NULL; /* Page never allocated */
 
-    /* TODO: Play with your paging theory here */
-    /* Find victim page */
-    find_victim_page(caller->mm, &vicpgn);
-    int vicfpn = PAGING_FPN(mm->pgd[vicpgn]);
+  if (paging_huge_pgnum && pg_huge_fits(mm, pgn) &&
+      vmap_huge_page(caller, (pgn & ~(paging_huge_pgnum - 1)) <<
+                             PAGING_ADDR_PGN_LOBIT) == 0)
+  {
+    atomic_fetch_add(&pgrepl_zero_faults, 1);
+    return pte_get(mm, pgn);
+  }
 
-    /* Get free frame in MEMSWP */
-    MEMPHY_get_freefp(caller->active_mswp, &swpfpn);
+  /* The frame may come from an eviction, see the swap in below. Only
+   * this CPU maps pages of the mm, the PTE is still unused afterwards */
+  mm_unlock(mm);
+  if (reclaim_get_frame(caller, &fpn) < 0)
+  {
+    mm_lock(mm);
+    return NULL;
+  }
+  mm_lock(mm);
 
+  ptep = pte_alloc(mm, pgn);
+  if (ptep == NULL)
+  {
+    MEMPHY_put_freefp(caller->mram, fpn);
+    return NULL;
+  }
+  MEMPHY_zero(caller->mram, fpn * PAGING_PAGESZ, PAGING_PAGESZ);
+  pte_set_fpn(ptep, fpn);
+  MEMPHY_set_owner(caller->mram, fpn, mm, pgn);
+  pgrepl_add(mm, pgn);
+  atomic_fetch_add(&pgrepl_zero_faults, 1);
+  return ptep;
+}
 
-    /* Do swap frame from MEMRAM to MEMSWP and vice versa*/
-    /* Copy victim frame to swap */
-    __swap_cp_page(caller->mram, vicfpn, caller->active_mswp, swpfpn);
-    /* Copy target frame from swap to mem */
-    __swap_cp_page(caller->active_mswp, tgtfpn, caller->active_mswp, vicfpn);
+/*pg_getpage - get the page in ram, the caller holds the lock of the mm
+ *@mm: memory region
+ *@pagenum: PGN
+ *@framenum: return FPN
+ *@caller: caller
+ *
+ *The frame stays the page's until the lock is released, evictions take
+ *the lock of the mm they change
+ */
+int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
+{
+  uint32_t *ptep = pte_get(mm, pgn);
+
+  pgrepl_access(mm, caller, pgn);
+  if (ptep == NULL || !PAGING_PAGE_PRESENT(*ptep))
+  { /* First access to the page */
+    ptep = pg_demand_zero(mm, pgn, caller);
+    if (ptep == NULL)
+      return -1;
+  }
 
-    MEMPHY_put_freefp(caller->active_mswp, tgtfpn);
+  if (*ptep & PAGING_PTE_HUGE_MASK)
+    return pg_gethuge(ptep, pgn, fpn);
+  if (tlb_lookup(ptep, fpn) == 0)
+    return 0;
 
-    /* Update page table */
-    //pte_set_swap() &mm->pgd;
-    pte_set_swap(&mm->pgd[vicpgn], 0, swpfpn);
+  uint32_t pte = *ptep;
+  if (PAGING_PAGE_SWAPPED(pte))
+  { /* Page is not online, make it actively living */
+    int vicfpn, out_slots;
+
+    atomic_fetch_add(&pgrepl_faults, 1);
+
+    /* Take a free frame if any, else evict a page of any process. The
+     * eviction may pick a page of this mm, its lock is dropped meanwhile.
+     * Only this CPU maps pages of the mm, the page stays swapped */
+    mm_unlock(mm);
+    out_slots = reclaim_get_frame(caller, &vicfpn);
+    mm_lock(mm);
+    if (out_slots < 0)
+      return -1;
+
+    /* Copy target frame from swap to mem, the swap copy is kept while
+     * the page stays clean */
+    reclaim_fault(reclaim_swap_in(caller, pte, vicfpn), out_slots);
 
     /* Update its online status of the target page */
-    //pte_set_fpn() & mm->pgd[pgn];
-    pte_set_fpn(&mm->pgd[pgn], vicfpn);
-    *fpn = vicfpn;
-    enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
-    return 0;
+    pte_set_fpn(ptep, vicfpn);
+    MEMPHY_set_owner(caller->mram, vicfpn, mm, pgn);
+    pgrepl_add(caller->mm, pgn);
   }
 
-  *fpn = PAGING_FPN(pte);
+  *fpn = PAGING_PTE_FPN(*ptep);
+  SETBIT(*ptep, PAGING_PTE_REFERENCED_MASK);
+  tlb_insert(ptep, *fpn);
   return 0;
 }
 
@@ -227,12 +364,17 @@ int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller)
   int fpn;
 
   /* Get the page to MEMRAM, swap from MEMSWAP if needed */
+  mm_lock(mm);
   if(pg_getpage(mm, pgn, &fpn, caller) != 0) 
+  {
+    mm_unlock(mm);
     return -1; /* invalid page access */
+  }
 
   int phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
 
   MEMPHY_read(caller->mram,phyaddr, data);
+  mm_unlock(mm);
 
   return 0;
 }
@@ -249,12 +391,25 @@ int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
   int off = PAGING_OFFST(addr);
   int fpn;
 
-  /* Get the page to MEMRAM, swap from MEMSWAP if needed */
-  if(pg_getpage(mm, pgn, &fpn, caller) != 0) 
+  /* Get the page to MEMRAM, swap from MEMSWAP if needed. A page shared
+   * copy-on-write gets a frame of its own, it may be evicted meanwhile */
+  mm_lock(mm);
+  int err;
+  do
+    err = pg_getpage(mm, pgn, &fpn, caller);
+  while (err == 0 && (*pte_get(mm, pgn) & PAGING_PTE_COW_MASK) &&
+         (err = reclaim_cow_break(caller, pgn, &fpn)) > 0);
+  if(err != 0) 
+  {
+    mm_unlock(mm);
     return -1; /* invalid page access */
+  }
+  /* Its swap copy is stale from now on */
+  SETBIT(*pte_get(mm, pgn), PAGING_PTE_DIRTY_MASK);
   int phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
 
   MEMPHY_write(caller->mram,phyaddr, value);
+  mm_unlock(mm);
 
    return 0;
 }
@@ -344,34 +499,6 @@ int pgwrite(
 }
 
 
-/*free_pcb_memphy - collect all memphy of pcb
- *@caller: caller
- *@vmaid: ID vm area to alloc memory region
- *@incpgnum: number of page
- */
-int free_pcb_memph(struct pcb_t *caller)
-{
-  int pagenum, fpn;
-  uint32_t pte;
-
-
-  for(pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
-  {
-    pte= caller->mm->pgd[pagenum];
-
-    if (!PAGING_PAGE_PRESENT(pte))
-    {
-      fpn = PAGING_FPN(pte);
-      MEMPHY_put_freefp(caller->mram, fpn);
-    } else {
-      fpn = PAGING_SWP(pte);
-      MEMPHY_put_freefp(caller->active_mswp, fpn);    
-    }
-  }
-
-  return 0;
-}
-
 /*get_vm_area_node - get vm area for a number of pages
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
@@ -417,27 +544,231 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int
  */
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)
 {
-  struct vm_rg_struct * newrg = malloc(sizeof(struct vm_rg_struct));
   int inc_amt = PAGING_PAGE_ALIGNSZ(inc_sz);
-  int incnumpage =  inc_amt / PAGING_PAGESZ;
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid); 
   struct vm_rg_struct *area = get_vm_area_node_at_brk(caller, vmaid, inc_sz, inc_amt); //Create new region node at sbrk 
+  int ret = 0;
 
-  int old_end = cur_vma->vm_end;
-
+  if (cur_vma->vm_end + inc_amt > BIT(PAGING_CPU_BUS_WIDTH))
+    ret = -1; /* Past the address space, its pages would alias */
   /*Validate overlap of obtained region */
-  if (validate_overlap_vm_area(caller, vmaid, area->rg_start, area->rg_end) < 0)
-    return -1; /*Overlap and failed allocation */
-
-  /* The obtained vm area (only) 
-   * now will be alloc real ram region */
-  cur_vma->vm_end += inc_sz;
-  if (vm_map_ram(caller, area->rg_start, area->rg_end, 
-                    old_end, incnumpage , newrg) < 0)
-    return -1; /* Map the memory to MEMRAM */
-  free(newrg);
+  else if (validate_overlap_vm_area(caller, vmaid, area->rg_start, area->rg_end) < 0)
+    ret = -1; /*Overlap and failed allocation */
+  else
+    /* Only the virtual space is reserved, a page gets a zeroed frame on
+     * its first access (pg_getpage) */
+    cur_vma->vm_end += inc_sz;
+
+  free(area);
+  return ret;
+}
+
+
+/* Page reference trace being recorded, one "pid pgn" line per access */
+static FILE *pgtrace_file;
+static pthread_mutex_t pgtrace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Reference strings of a recorded trace for the OPT oracle, by pid */
+struct opt_ref_t {
+  int *ref;
+  long len;
+  long cap;
+};
+static struct opt_ref_t *opt_refs;
+static int opt_nr_pids;
+
+static int load_opt_trace(const char *path)
+{
+  FILE *file = fopen(path, "r");
+  int pid, pgn;
+
+  if (file == NULL)
+    return -1;
+
+  while (fscanf(file, "%d %d", &pid, &pgn) == 2)
+  {
+    if (pid < 0)
+      continue;
+    if (pid >= opt_nr_pids)
+    {
+      int n = (pid + 1) * 2;
+      opt_refs = realloc(opt_refs, n * sizeof(struct opt_ref_t));
+      memset(opt_refs + opt_nr_pids, 0,
+             (n - opt_nr_pids) * sizeof(struct opt_ref_t));
+      opt_nr_pids = n;
+    }
+    struct opt_ref_t *r = &opt_refs[pid];
+    if (r->len == r->cap)
+    {
+      r->cap = r->cap ? r->cap * 2 : 64;
+      r->ref = realloc(r->ref, r->cap * sizeof(int));
+    }
+    r->ref[r->len++] = pgn;
+  }
+  fclose(file);
+  return 0;
+}
+
+/*pgrepl_set_policy - select the page replacement policy
+ *@policy: policy
+ *@trace: recorded trace the OPT oracle looks ahead in
+ *
+ */
+int pgrepl_set_policy(enum pgrepl_policy_t policy, const char *trace)
+{
+  if (policy == PGREPL_OPT && (trace == NULL || load_opt_trace(trace) < 0))
+    return -1;
+
+  pgrepl_policy = policy;
   return 0;
+}
+
+/*pgrepl_set_trace - record the page references of every process
+ *@path: trace file, in the format the OPT oracle reads
+ *
+ */
+int pgrepl_set_trace(const char *path)
+{
+  pgtrace_file = fopen(path, "w");
+  return (pgtrace_file == NULL) ? -1 : 0;
+}
+
+/*pgrepl_init_mm - set up an empty resident set
+ *@mm: memory region
+ *@caller: mm owner
+ *
+ */
+int pgrepl_init_mm(struct mm_struct *mm, struct pcb_t *caller)
+{
+  struct pgrepl_struct *r = &mm->pgrepl;
+
+  r->cap = 16;
+  r->pgn = malloc(r->cap * sizeof(int));
+  r->head = r->count = 0;
+  r->age = NULL;
+  r->opt_ref = NULL;
+  r->opt_len = r->opt_pos = 0;
+  if (caller->pid < opt_nr_pids)
+  {
+    r->opt_ref = opt_refs[caller->pid].ref;
+    r->opt_len = opt_refs[caller->pid].len;
+  }
+  return (r->pgn == NULL) ? -1 : 0;
+}
+
+#define PGREPL_AT(r, i) ((r)->pgn[((r)->head + (i)) & ((r)->cap - 1)])
+
+/*pgrepl_add - a page of the mm became resident
+ *@mm: memory region
+ *@pgn: page number
+ *
+ */
+int pgrepl_add(struct mm_struct *mm, int pgn)
+{
+  struct pgrepl_struct *r = &mm->pgrepl;
+
+  if (r->count == r->cap)
+  {
+    int *ring = malloc(2 * r->cap * sizeof(int));
+    int i;
+
+    if (ring == NULL)
+      return -1;
+    for (i = 0; i < r->count; i++)
+      ring[i] = PGREPL_AT(r, i);
+    free(r->pgn);
+    r->pgn = ring;
+    r->cap *= 2;
+    r->head = 0;
+  }
+  PGREPL_AT(r, r->count) = pgn;
+  r->count++;
+  if (r->count > mm->rss_peak)
+    mm->rss_peak = r->count;
+
+  if (pgrepl_policy == PGREPL_LRU)
+  {
+    if (r->age == NULL)
+      r->age = calloc(PAGING_MAX_PGN, sizeof(uint8_t));
+    if (r->age != NULL)
+      r->age[pgn] = 0;
+  }
+  return 0;
+}
+
+/* Remove the [i]th resident page in O(1). The oldest one is popped off
+ * the head, any other is replaced by the newest page: only FIFO and
+ * CLOCK depend on the order, and they always take the oldest page */
+static int pgrepl_remove(struct pgrepl_struct *r, int i)
+{
+  int pgn = PGREPL_AT(r, i);
+
+  if (i == 0)
+    r->head = (r->head + 1) & (r->cap - 1);
+  else
+    PGREPL_AT(r, i) = PGREPL_AT(r, r->count - 1);
+  r->count--;
+  return pgn;
+}
+
+/* Test and clear the referenced bit of a resident page. The TLB entry
+ * is dropped too, so the next access goes through the PTE again */
+static int pgrepl_referenced(struct mm_struct *mm, int pgn)
+{
+  uint32_t *pte = pte_get(mm, pgn);
+
+  if (!(*pte & PAGING_PTE_REFERENCED_MASK))
+    return 0;
+  CLRBIT(*pte, PAGING_PTE_REFERENCED_MASK);
+  tlb_invalidate(pte);
+  return 1;
+}
+
+/* Index of the resident page used farthest in the future, an unused
+ * one first */
+static int opt_victim(struct mm_struct *mm)
+{
+  struct pgrepl_struct *r = &mm->pgrepl;
+  long best = -1;
+  int i, victim = 0;
+
+  for (i = 0; i < r->count; i++)
+  {
+    long pos = r->opt_pos;
+    while (pos < r->opt_len && r->opt_ref[pos] != PGREPL_AT(r, i))
+      pos++;
+    if (pos > best)
+    {
+      best = pos;
+      victim = i;
+      if (pos == r->opt_len)
+        break;
+    }
+  }
+  return victim;
+}
 
+/* Index of the resident page with the lowest age. Every resident page
+ * is aged with its referenced bit here, ie once per eviction from the
+ * mm rather than on every fault: faults served by a free frame cost no
+ * walk of the resident set */
+static int lru_victim(struct mm_struct *mm)
+{
+  struct pgrepl_struct *r = &mm->pgrepl;
+  int i, victim = 0;
+
+  if (r->age == NULL)
+    return 0;
+
+  for (i = 0; i < r->count; i++)
+  {
+    int pgn = PGREPL_AT(r, i);
+    r->age[pgn] = (r->age[pgn] >> 1) |
+                  (pgrepl_referenced(mm, pgn) ? 0x80 : 0);
+    if (r->age[pgn] < r->age[PGREPL_AT(r, victim)])
+      victim = i;
+  }
+  return victim;
 }
 
 /*find_victim_page - find victim page
@@ -447,23 +778,74 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)
  */
 int find_victim_page(struct mm_struct *mm, int *retpgn) 
 {
-  struct pgn_t *pg = mm->fifo_pgn;
-  if(!pg) return -1;
-  /* TODO: Implement the theorical mechanism to find the victim page */
-  while(pg->pg_next) pg = pg->pg_next;
-  *retpgn = pg->pgn;
-  if(mm->fifo_pgn == pg) {
-    mm->fifo_pgn = NULL;
-    free(pg);
-    return 0;
+  struct pgrepl_struct *r = &mm->pgrepl;
+  int victim = 0;
+
+  if (r->count == 0)
+    return -1;
+
+  switch (pgrepl_policy)
+  {
+  case PGREPL_CLOCK:
+    /* Move the hand past the referenced pages, at most one round */
+    while (victim < r->count && pgrepl_referenced(mm, PGREPL_AT(r, 0)))
+    {
+      PGREPL_AT(r, r->count) = PGREPL_AT(r, 0);
+      r->head = (r->head + 1) & (r->cap - 1);
+      victim++;
+    }
+    victim = 0;
+    break;
+  case PGREPL_LRU:
+    victim = lru_victim(mm);
+    break;
+  case PGREPL_OPT:
+    if (r->opt_ref != NULL)
+      victim = opt_victim(mm);
+    break;
+  default:
+    break;
   }
-  struct pgn_t *after_tail = mm->fifo_pgn;
-  while(after_tail->pg_next != pg) after_tail = after_tail->pg_next;
-  after_tail->pg_next = NULL;
-  free(pg);
+
+  *retpgn = pgrepl_remove(r, victim);
+  atomic_fetch_add(&pgrepl_evictions, 1);
   return 0;
 }
 
+/*pgrepl_access - a page of the mm is accessed
+ *@mm: memory region
+ *@caller: mm owner
+ *@pgn: page number
+ *
+ */
+void pgrepl_access(struct mm_struct *mm, struct pcb_t *caller, int pgn)
+{
+  if (pgtrace_file != NULL)
+  {
+    pthread_mutex_lock(&pgtrace_lock);
+    fprintf(pgtrace_file, "%d %d\n", caller->pid, pgn);
+    pthread_mutex_unlock(&pgtrace_lock);
+  }
+  if (mm->pgrepl.opt_pos < mm->pgrepl.opt_len)
+    mm->pgrepl.opt_pos++;
+}
+
+/*pgrepl_report - print the page faults of the run and close the trace
+ *
+ */
+void pgrepl_report(void)
+{
+  printf("Page replacement (%s): %lu faults, %lu evictions,"
+         " %lu pages zero-filled on first access\n",
+         pgrepl_names[pgrepl_policy], atomic_load(&pgrepl_faults),
+         atomic_load(&pgrepl_evictions), atomic_load(&pgrepl_zero_faults));
+  if (pgtrace_file != NULL)
+  {
+    fclose(pgtrace_file);
+    pgtrace_file = NULL;
+  }
+}
+
 /*get_free_vmrg_area - get a free vm region
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
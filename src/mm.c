@@ -5,8 +5,49 @@
  */
 
 #include "mm.h"
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+int paging_pagesz = PAGING_PAGESZ_MIN;
+int paging_pgshift = 8;
+
+int paging_huge_pgnum;
+static atomic_int huge_frames; /* MEMRAM frames pinned by huge pages */
+static atomic_ulong huge_mapped, huge_fallback;
+
+/*
+ * paging_set_pagesz - choose the page size, before any device or mm is
+ *                     set up
+ * @pagesz: a power of two from PAGING_PAGESZ_MIN to PAGING_PAGESZ_MAX
+ */
+int paging_set_pagesz(int pagesz)
+{
+  if (pagesz < PAGING_PAGESZ_MIN || pagesz > PAGING_PAGESZ_MAX ||
+      (pagesz & (pagesz - 1)))
+    return -1;
+
+  paging_pagesz = pagesz;
+  paging_pgshift = __builtin_ctz(pagesz);
+  return 0;
+}
+
+/*
+ * paging_set_huge - map large regions with huge pages
+ * @pgnum : pages per huge page, a power of two up to 64, 0 disables them
+ */
+int paging_set_huge(int pgnum)
+{
+  /* A huge page is taken from one word of the frame bitmap and its PTEs
+   * lie in one page table */
+  if (pgnum != 0 && (pgnum < 2 || pgnum > 64 || (pgnum & (pgnum - 1))))
+    return -1;
+
+  paging_huge_pgnum = pgnum;
+  return 0;
+}
 
 /* 
  * init_pte - Initialize PTE entry
@@ -51,8 +92,14 @@ int init_pte(uint32_t *pte,
  */
 int pte_set_swap(uint32_t *pte, int swptyp, int swpoff)
 {
+  tlb_invalidate(pte);
+
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
+  CLRBIT(*pte, PAGING_PTE_REFERENCED_MASK);
+  CLRBIT(*pte, PAGING_PTE_DIRTY_MASK);
+  CLRBIT(*pte, PAGING_PTE_HUGE_MASK);
+  CLRBIT(*pte, PAGING_PTE_COW_MASK);
 
   SETVAL(*pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
   SETVAL(*pte, swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
@@ -67,128 +114,125 @@ int pte_set_swap(uint32_t *pte, int swptyp, int swpoff)
  */
 int pte_set_fpn(uint32_t *pte, int fpn)
 {
+  tlb_invalidate(pte);
+
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
+  CLRBIT(*pte, PAGING_PTE_DIRTY_MASK);
+  CLRBIT(*pte, PAGING_PTE_HUGE_MASK);
+  CLRBIT(*pte, PAGING_PTE_COW_MASK);
 
   SETVAL(*pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT); 
 
   return 0;
 }
 
-
-/* 
- * vmap_page_range - map a range of page at aligned address
+/*
+ * pte_get - PTE of a page
+ * @mm    : self mm
+ * @pgn   : page number
+ * Return NULL if no page of its page table was ever mapped
  */
-int vmap_page_range(struct pcb_t *caller, // process call
-                                int addr, // start address which is aligned to pagesz
-                               int pgnum, // num of mapping page
-           struct framephy_struct *frames,// list of the mapped frames
-              struct vm_rg_struct *ret_rg)// return mapped region, the real mapped fp
-{                                         // no guarantee all given pages are mapped
-  //uint32_t * pte = malloc(sizeof(uint32_t));
-  struct framephy_struct *fpit = frames;
-  int pgit = 0;
-  ret_rg->rg_end = ret_rg->rg_start = addr; // at least the very first space is usable
-
-  /* TODO map range of frame to address space 
-   *      [addr to addr + pgnum*PAGING_PAGESZ
-   *      in page table caller->mm->pgd[]
-   */
-  for(pgit; pgit < pgnum; pgit++) {
-    int pgn = PAGING_PGN(addr);
-		pte_set_fpn(&caller->mm->pgd[pgn], fpit->fpn);
-		fpit = fpit->fp_next;
-		addr += PAGING_PAGESZ;
-		ret_rg->rg_end = addr;
-   	enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
-  }
+uint32_t *pte_get(struct mm_struct *mm, int pgn)
+{
+  uint32_t *pt = mm->pgd[PAGING_PGD_IDX(pgn)];
 
-   /* Tracking for later page replacement activities (if needed)
-    * Enqueue new usage page */
-  return 0;
+  return (pt != NULL) ? &pt[PAGING_PT_IDX(pgn)] : NULL;
 }
 
-/* 
- * alloc_pages_range - allocate req_pgnum of frame in ram
- * @caller    : caller
- * @req_pgnum : request page num
- * @frm_lst   : frame list
+/*
+ * pte_alloc - PTE of a page being mapped, its page table is allocated
+ *             if needed, the caller holds the lock of the mm
+ * @mm    : self mm
+ * @pgn   : page number
  */
-
-int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct** frm_lst)
+uint32_t *pte_alloc(struct mm_struct *mm, int pgn)
 {
-  int pgit, fpn;
-  struct framephy_struct dummy_head = { .fp_next = NULL };
-  struct framephy_struct *newfp_str = &dummy_head;
+  uint32_t **pt = &mm->pgd[PAGING_PGD_IDX(pgn)];
 
-  for(pgit = 0; pgit < req_pgnum; pgit++)
+  if (*pt == NULL)
   {
-    if(MEMPHY_get_freefp(caller->mram, &fpn) == 0)
-    {
-      newfp_str->fp_next = malloc(sizeof(struct framephy_struct));
-      newfp_str = newfp_str->fp_next;
-      newfp_str->fpn = fpn;
-      newfp_str->owner = caller->mm;
-    } else {  // ERROR CODE of obtaining somes but not enough frames
-			// Implement page replacement
-      int vicpgn, swpfpn; 
-      find_victim_page(caller->mm, &vicpgn);
-      MEMPHY_get_freefp(caller->active_mswp, &swpfpn);
-      __swap_cp_page(caller->mram, PAGING_FPN(caller->mm->pgd[vicpgn]), caller->active_mswp, swpfpn);
-      MEMPHY_put_freefp(caller->mram, vicpgn);
-      pte_set_swap(&caller->mm->pgd[vicpgn], 0, swpfpn);  
-      pgit--;
-    } 
+    *pt = calloc(PAGING_PT_ENTRIES, sizeof(uint32_t));
+    if (*pt == NULL)
+      return NULL;
+    mm->nr_pt++;
   }
-  *frm_lst = dummy_head.fp_next;
-  return 0;
+  return &(*pt)[PAGING_PT_IDX(pgn)];
+}
+
+/*
+ * mm_pgtable_bytes - host memory taken by the page table of an mm
+ * @mm    : self mm
+ */
+int mm_pgtable_bytes(struct mm_struct *mm)
+{
+  return PAGING_PGD_ENTRIES * sizeof(uint32_t *) +
+         mm->nr_pt * PAGING_PT_ENTRIES * sizeof(uint32_t);
 }
 
 
-/* 
- * vm_map_ram - do the mapping all vm are to ram storage device
- * @caller    : caller
- * @astart    : vm area start
- * @aend      : vm area end
- * @mapstart  : start mapping point
- * @incpgnum  : number of mapped page
- * @ret_rg    : returned region
+/*
+ * vmap_huge_page - map a huge page at a huge page aligned address, the
+ *                  caller holds the lock of the mm
+ * @caller : caller
+ * @addr   : start address, none of its pages is mapped
+ *
+ * The pages take paging_huge_pgnum contiguous zeroed frames of MEMRAM
+ * and are pinned there, the replacement policy never sees them. At most
+ * half of MEMRAM is pinned, so the other processes can still be paged in
  */
-int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int incpgnum, struct vm_rg_struct *ret_rg)
+int vmap_huge_page(struct pcb_t *caller, int addr)
 {
-  struct framephy_struct *frm_lst = NULL;
-  int ret_alloc;
-
-  /*@bksysnet: author provides a feasible solution of getting frames
-   *FATAL logic in here, wrong behaviour if we have not enough page
-   *i.e. we request 1000 frames meanwhile our RAM has size of 3 frames
-   *Don't try to perform that case in this simple work, it will result
-   *in endless procedure of swap-off to get frame and we have not provide 
-   *duplicate control mechanism, keep it simple
-   */
-  ret_alloc = alloc_pages_range(caller, incpgnum, &frm_lst);
-
-  if (ret_alloc < 0 && ret_alloc != -3000)
+  struct mm_struct *mm = caller->mm;
+  int pgn = PAGING_PGN(addr);
+  int fpn, i;
+  uint32_t *pte;
+
+  if (atomic_fetch_add(&huge_frames, paging_huge_pgnum) + paging_huge_pgnum >
+        caller->mram->numfp / 2 ||
+      MEMPHY_get_freefp_range(caller->mram, paging_huge_pgnum, &fpn) < 0)
+  {
+    atomic_fetch_sub(&huge_frames, paging_huge_pgnum);
+    atomic_fetch_add(&huge_fallback, 1);
     return -1;
+  }
 
-  /* Out of memory */
-  if (ret_alloc == -3000) 
+  pte = pte_alloc(mm, pgn);
+  if (pte == NULL)
   {
-#ifdef MMDBG
-     printf("OOM: vm_map_ram out of memory \n");
-#endif
-
+    for (i = 0; i < paging_huge_pgnum; i++)
+      MEMPHY_put_freefp(caller->mram, fpn + i);
+    atomic_fetch_sub(&huge_frames, paging_huge_pgnum);
     return -1;
   }
+  MEMPHY_zero(caller->mram, fpn * PAGING_PAGESZ,
+              paging_huge_pgnum * PAGING_PAGESZ);
+  /* The run lies in one page table */
+  for (i = 0; i < paging_huge_pgnum; i++)
+  {
+    pte_set_fpn(&pte[i], fpn + i);
+    SETBIT(pte[i], PAGING_PTE_HUGE_MASK);
+    MEMPHY_set_owner(caller->mram, fpn + i, mm, pgn + i);
+  }
+  mm->nr_huge += paging_huge_pgnum;
 
-  /* it leaves the case of memory is enough but half in ram, half in swap
-   * do the swaping all to swapper to get the all in ram */
-  
-  vmap_page_range(caller, mapstart, incpgnum, frm_lst, ret_rg);
-
+  atomic_fetch_add(&huge_mapped, 1);
   return 0;
 }
 
+/*
+ * paging_report - print the page size and the huge pages mapped
+ */
+void paging_report(void)
+{
+  printf("Paging: %d-byte pages", PAGING_PAGESZ);
+  if (paging_huge_pgnum)
+    printf(", huge pages of %d pages: %lu mapped, %lu fell back to"
+           " pages", paging_huge_pgnum, atomic_load(&huge_mapped),
+           atomic_load(&huge_fallback));
+  printf("\n");
+}
+
 /* Swap copy content page from source frame to destination frame 
  * @mpsrc  : source memphy
  * @srcfpn : source physical page number (FPN)
@@ -198,19 +242,7 @@ int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int inc
 int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
                 struct memphy_struct *mpdst, int dstfpn) 
 {
-  int cellidx;
-  int addrsrc,addrdst;
-  for(cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
-  {
-    addrsrc = srcfpn * PAGING_PAGESZ + cellidx;
-    addrdst = dstfpn * PAGING_PAGESZ + cellidx;
-
-    BYTE data;
-    MEMPHY_read(mpsrc, addrsrc, &data);
-    MEMPHY_write(mpdst, addrdst, data);
-  }
-
-  return 0;
+  return MEMPHY_cp_frame(mpsrc, srcfpn, mpdst, dstfpn, PAGING_PAGESZ);
 }
 
 /*
@@ -222,7 +254,12 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
 {
   struct vm_area_struct * vma = malloc(sizeof(struct vm_area_struct));
 
-  mm->pgd = malloc(PAGING_MAX_PGN*sizeof(uint32_t));
+  mm->pgd = calloc(PAGING_PGD_ENTRIES, sizeof(uint32_t *));
+  mm->nr_pt = 0;
+  mm->nr_huge = 0;
+  memset(mm->symrgtbl, 0, sizeof(mm->symrgtbl));
+  pgrepl_init_mm(mm, caller);
+  reclaim_register_mm(mm, caller);
 
   /* By default the owner comes with at least one vma */
   vma->vm_id = 1;
@@ -230,6 +267,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   vma->vm_end = vma->vm_start;
   vma->sbrk = vma->vm_start;
   struct vm_rg_struct *first_rg = init_vm_rg(vma->vm_start, vma->vm_end);
+  vma->vm_freerg_list = NULL;
   enlist_vm_rg_node(&vma->vm_freerg_list, first_rg);
 
   vma->vm_next = NULL;
@@ -240,6 +278,87 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   return 0;
 }
 
+/*
+ *free_mm - release a Memory Management instance, its frames are given
+ *          back by free_pcb_memph() first
+ * @mm:     self mm
+ */
+void free_mm(struct mm_struct *mm)
+{
+  struct vm_area_struct *vma = mm->mmap;
+  int i;
+
+  while (vma != NULL)
+  {
+    struct vm_area_struct *next = vma->vm_next;
+    struct vm_rg_struct *rg = vma->vm_freerg_list;
+
+    while (rg != NULL)
+    {
+      struct vm_rg_struct *rgnext = rg->rg_next;
+      free(rg);
+      rg = rgnext;
+    }
+    free(vma);
+    vma = next;
+  }
+  free(mm->pgrepl.pgn);
+  free(mm->pgrepl.age);
+  for (i = 0; i < PAGING_PGD_ENTRIES; i++)
+    free(mm->pgd[i]);
+  free(mm->pgd);
+  atomic_fetch_sub(&huge_frames, mm->nr_huge);
+  pthread_mutex_destroy(&mm->lock);
+  mm->mmap = NULL;
+  mm->pgd = NULL;
+}
+
+/*
+ *fork_mm - give a forked process a copy of the memory of its parent
+ * @child:  new process, its mm is allocated but not initialized
+ * @parent: forking process
+ *
+ * The regions and the free lists are copied, the pages in MEMRAM are
+ * shared copy-on-write by reclaim_fork_pages()
+ */
+int fork_mm(struct pcb_t *child, struct pcb_t *parent)
+{
+  struct mm_struct *mm = child->mm;
+  struct vm_area_struct *pvma, *vma, **vmatail;
+  struct vm_rg_struct *prg, **rgtail;
+
+  init_mm(mm, child);
+  memcpy(mm->symrgtbl, parent->mm->symrgtbl, sizeof(mm->symrgtbl));
+
+  /* The regions only change on the CPU running the parent */
+  free(mm->mmap->vm_freerg_list);
+  free(mm->mmap);
+  vmatail = &mm->mmap;
+  for (pvma = parent->mm->mmap; pvma != NULL; pvma = pvma->vm_next)
+  {
+    vma = malloc(sizeof(struct vm_area_struct));
+    *vma = *pvma;
+    vma->vm_mm = mm;
+    rgtail = &vma->vm_freerg_list;
+    for (prg = pvma->vm_freerg_list; prg != NULL; prg = prg->rg_next)
+    {
+      *rgtail = init_vm_rg(prg->rg_start, prg->rg_end);
+      rgtail = &(*rgtail)->rg_next;
+    }
+    *vmatail = vma;
+    vmatail = &vma->vm_next;
+  }
+  *vmatail = NULL;
+
+  if (reclaim_fork_pages(parent, child) < 0)
+  {
+    free_pcb_memph(child);
+    free_mm(mm);
+    return -1;
+  }
+  return 0;
+}
+
 struct vm_rg_struct* init_vm_rg(int rg_start, int rg_end)
 {
   struct vm_rg_struct *rgnode = malloc(sizeof(struct vm_rg_struct));
@@ -350,10 +469,13 @@ int print_pgtbl(struct pcb_t *caller, uint32_t start, uint32_t end)
     printf("\n");
 
 
+  mm_lock(caller->mm);
   for(pgit = pgn_start; pgit < pgn_end; pgit++)
   {
-     printf("%08ld: %08x\n", pgit * sizeof(uint32_t), caller->mm->pgd[pgit]);
+     uint32_t *pte = pte_get(caller->mm, pgit);
+     printf("%08ld: %08x\n", pgit * sizeof(uint32_t), pte ? *pte : 0);
   }
+  mm_unlock(caller->mm);
 
   return 0;
 }
@@ -6,17 +6,48 @@
 #include "mm.h"
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 static int time_slot;
 static int num_cpus;
 static int done = 0;
+static int macro_slot = 0;
+#ifdef MM_PAGING
+static int kswapd = 0;
+#endif
+
+/* Schedule trace, one "time event pid" record per scheduling event. The
+ * CPU is left out since which idle CPU picks a process up is up to the
+ * host thread scheduler */
+static FILE * sched_trace_file = NULL;
+static const char * sched_trace_path = NULL;
+static const char * sched_verify_path = NULL;
+
+/* While tracing, CPUs look at the ready queue only once the loader is
+ * done with the current slot, so a process arriving in a slot is seen
+ * by idle CPUs in that very slot whatever the thread timing is */
+static int ordered_arrivals = 0;
+static uint64_t ld_synced_until = 0;	// First slot not published yet
+static pthread_mutex_t ld_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ld_cond = PTHREAD_COND_INITIALIZER;
 
 #ifdef MM_PAGING
 static int memramsz;
 static int memswpsz[PAGING_MAX_MMSWP];
+/* Latency, seek and transfer costs of MEMRAM then of each MEMSWP, in
+ * thousandths of a slot. Moving a page to or from swap takes a slot */
+static int mem_timing[1 + PAGING_MAX_MMSWP][3] = {
+	{ 0, 0, 0 },
+	{ MEMPHY_COST_UNIT, 0, 0 }, { MEMPHY_COST_UNIT, 0, 0 },
+	{ MEMPHY_COST_UNIT, 0, 0 }, { MEMPHY_COST_UNIT, 0, 0 },
+};
+/* Storage of MEMRAM then of each MEMSWP: NULL for malloc(), "anon" for
+ * an anonymous mapping or the path of a file to map */
+static const char * mem_file[1 + PAGING_MAX_MMSWP];
 
 struct mmpaging_ld_args {
 	/* A dispatched argument struct to compact many-fields passing to loader */
@@ -27,12 +58,20 @@ struct mmpaging_ld_args {
 };
 #endif
 
+/* The process entries of the config are read one at a time by the loader
+ * when it is done with the previous one, so only the next process to
+ * start is held in memory whatever the number of processes */
 static struct ld_args{
-	char ** path;
-	unsigned long * start_time;
-#ifdef MLQ_SCHED
-	unsigned long * prio;
-#endif
+	FILE * file;		// Config, positioned at the next entry
+	char * line;		// getline() buffer
+	size_t line_cap;
+	char * path;		// Current entry
+	size_t path_cap;
+	unsigned long start_time;
+	unsigned long prio;
+	unsigned long nr_read;	// Parse statistics
+	unsigned long bytes;
+	double parse_sec;
 } ld_processes;
 int num_processes;
 
@@ -41,63 +80,327 @@ struct cpu_args {
 	int id;
 };
 
+#ifdef MM_PAGING
+/* The page-out daemon runs until the loader and every CPU are done */
+static atomic_int cpus_running;
+
+struct kswapd_args {
+	struct timer_id_t * timer_id;
+	struct memphy_struct * mram;
+};
+#endif
+
+static void sched_trace(const char * event, int pid) {
+	if (sched_trace_file != NULL) {
+		fprintf(sched_trace_file, "%lu %s %d\n",
+			current_time(), event, pid);
+	}
+}
+
+static int cmp_line(const void * a, const void * b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Read all lines of [file] sorted, so records of the same slot compare
+ * equal whatever order the CPU threads wrote them in */
+static char ** read_sorted_lines(FILE * file, size_t * count) {
+	char ** lines = NULL;
+	size_t cap = 0, len = 0, n = 0;
+	char * line = NULL;
+	while (getline(&line, &len, file) != -1) {
+		if (n == cap) {
+			cap = cap ? cap * 2 : 64;
+			lines = realloc(lines, cap * sizeof(char *));
+		}
+		lines[n++] = strdup(line);
+	}
+	free(line);
+	qsort(lines, n, sizeof(char *), cmp_line);
+	*count = n;
+	return lines;
+}
+
+/* Compare the schedule trace of this run with the reference one */
+static int verify_sched_trace(void) {
+	FILE * ref = fopen(sched_verify_path, "r");
+	size_t nref, nrun, i;
+	int mismatch = 0;
+	if (ref == NULL) {
+		printf("Cannot find reference schedule trace at %s\n",
+			sched_verify_path);
+		return 1;
+	}
+	rewind(sched_trace_file);
+	char ** ref_lines = read_sorted_lines(ref, &nref);
+	char ** run_lines = read_sorted_lines(sched_trace_file, &nrun);
+	fclose(ref);
+
+	for (i = 0; i < nref && i < nrun; i++) {
+		if (strcmp(ref_lines[i], run_lines[i])) {
+			printf("Schedule trace mismatch: expected %s"
+				"                         got      %s",
+				ref_lines[i], run_lines[i]);
+			mismatch = 1;
+			break;
+		}
+	}
+	if (!mismatch && nref != nrun) {
+		printf("Schedule trace mismatch: %zu events, expected %zu\n",
+			nrun, nref);
+		mismatch = 1;
+	}
+	if (!mismatch) {
+		printf("Schedule trace matches %s (%zu events)\n",
+			sched_verify_path, nrun);
+	}
+	for (i = 0; i < nref; i++) free(ref_lines[i]);
+	for (i = 0; i < nrun; i++) free(run_lines[i]);
+	free(ref_lines);
+	free(run_lines);
+	return mismatch;
+}
+
+
+/* Loader side: arrivals of the current slot are all in the queue */
+static void ld_publish(int finished) {
+	if (!ordered_arrivals) {
+		done = finished;
+		return;
+	}
+	pthread_mutex_lock(&ld_lock);
+	ld_synced_until = current_time() + 1;
+	done = finished;
+	pthread_cond_broadcast(&ld_cond);
+	pthread_mutex_unlock(&ld_lock);
+}
+
+/* CPU side: wait for the arrivals of the current slot */
+static void wait_arrivals(void) {
+	if (!ordered_arrivals) {
+		return;
+	}
+	pthread_mutex_lock(&ld_lock);
+	while (!done && ld_synced_until <= current_time()) {
+		pthread_cond_wait(&ld_cond, &ld_lock);
+	}
+	pthread_mutex_unlock(&ld_lock);
+}
 
 static void * cpu_routine(void * args) {
 	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
 	int id = ((struct cpu_args*)args)->id;
 	/* Check for new process in ready queue */
+	int quantum = 0;
 	int time_left = 0;
 	struct pcb_t * proc = NULL;
+#ifdef MM_PAGING
+	if (tlb_attach_cpu() < 0) {
+		printf("\tCPU %d: cannot allocate its TLB\n", id);
+	}
+#endif
 	while (1) {
+		wait_arrivals();
 		/* Check the status of current process */
 		if (proc == NULL) {
 			/* No process is running, the we load new process from
 		 	* ready queue */
-			proc = get_proc(&time_slot);
-			if (proc == NULL) {
-				next_slot(timer_id);
-				continue; /* First load failed. skip dummy load */
-			}
+			proc = get_proc(id, &quantum);
 		}else if (proc->pc == proc->code->size) {
 			/* The porcess has finish it job */
 			printf("\tCPU %d: Processed %2d has finished\n",
 				id ,proc->pid);
-			free(proc);
-			proc = get_proc(&time_slot);
+			sched_trace("finish", proc->pid);
+#ifdef MM_PAGING
+			/* Every frame of the process goes back to the system */
+			int rss_peak = proc->mm->rss_peak;
+			int pgtable = mm_pgtable_bytes(proc->mm);
+			int rss = free_pcb_memph(proc);
+			printf("\tCPU %d: Process %2d released %d frames"
+				" (peak RSS %d, page table %d bytes)\n", id,
+				proc->pid, rss, rss_peak, pgtable);
+			free_mm(proc->mm);
+			free(proc->mm);
+#endif
+			unload(proc);
+			atomic_fetch_sub(&nr_live_procs, 1);
+			proc = get_proc(id, &quantum);
 			time_left = 0;
 		}else if (time_left == 0) {
 			/* The process has done its job in current time slot */
 			printf("\tCPU %d: Put process %2d to run queue\n",
 				id, proc->pid);
-			put_proc(proc);
-			proc = get_proc(&time_slot);
+			sched_trace("put", proc->pid);
+			put_proc(id, proc);
+			proc = get_proc(id, &quantum);
 		}
 		
 		/* Recheck process status after loading new process */
-		if (proc == NULL && done) {
-			/* No process to run, exit */
+		if (proc == NULL && done &&
+				atomic_load(&nr_live_procs) == 0) {
+			/* No process to run and none to be forked, exit */
 			printf("\tCPU %d stopped\n", id);
+			sched_trace("stop", 0);
+#ifdef MM_PAGING
+			atomic_fetch_sub(&cpus_running, 1);
+#endif
 			break;
 		}else if (proc == NULL) {
 			/* There may be new processes to run in
 			 * next time slots, just skip current slot */
-			next_slot(timer_id);
+			idle_slot(timer_id, TIMER_NEVER);
 			continue;
 		}else if (time_left == 0) {
 			printf("\tCPU %d: Dispatched process %2d\n",
 				id, proc->pid);
-			time_left = time_slot;
+			sched_trace("dispatch", proc->pid);
+#ifdef MM_PAGING
+			/* No address space id in the TLB entries */
+			tlb_switch_mm(proc->mm);
+#endif
+			time_left = quantum;
 		}
 		
 		/* Run current process */
+		if (macro_slot) {
+			/* Run the pure computation ahead locally, the timer
+			 * only hears from us once the batch is over */
+			uint32_t n = run_calc(proc, time_left);
+			if (n > 0) {
+				time_left -= n;
+				next_slots(timer_id, n);
+				continue;
+			}
+		}
 		run(proc);
 		time_left--;
+#ifdef MM_PAGING
+		/* The CPU stalls while its accesses keep the memory devices
+		 * busy, the process keeps its remaining time */
+		uint32_t stall = MEMPHY_take_stall();
+		if (stall > 0) {
+			next_slots(timer_id, 1 + stall);
+			continue;
+		}
+#endif
 		next_slot(timer_id);
 	}
+#ifdef MM_PAGING
+	tlb_detach_cpu();
+#endif
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+#ifdef MM_PAGING
+static void * kswapd_routine(void * args) {
+	struct kswapd_args * ka = (struct kswapd_args *)args;
+	while (!done || atomic_load(&cpus_running) > 0) {
+		int slots = kswapd_balance(ka->mram);
+		if (slots > 1) {
+			next_slots(ka->timer_id, slots);
+		}else if (slots == 1) {
+			next_slot(ka->timer_id);
+		}else{
+			/* Only the faults of the CPUs give it work */
+			idle_slot(ka->timer_id, TIMER_NEVER);
+		}
+	}
+	detach_event(ka->timer_id);
+	pthread_exit(NULL);
+}
+#endif
+
+#ifdef MM_PAGING
+/* Create device [dev] of mem_file and mem_timing */
+static void init_memphy_dev(struct memphy_struct * mp, int dev, int size,
+		int rdmflag) {
+	/* Larger devices would have frames their PTE fields cannot hold */
+	long maxfp = (dev == 0) ? PAGING_PTE_MAX_FPN : PAGING_PTE_MAX_SWPOFF;
+	if (size / PAGING_PAGESZ > maxfp) {
+		if (dev == 0) {
+			printf("MEMRAM");
+		}else{
+			printf("MEMSWP %d", dev - 1);
+		}
+		printf(" of %d bytes has more than %ld frames of %d bytes\n",
+			size, maxfp, PAGING_PAGESZ);
+		exit(1);
+	}
+	if (mem_file[dev] == NULL) {
+		init_memphy(mp, size, rdmflag);
+	}else if (init_memphy_mapped(mp, size, rdmflag,
+			strcmp(mem_file[dev], "anon") ? mem_file[dev] : NULL) < 0) {
+		perror(mem_file[dev]);
+		exit(1);
+	}
+	MEMPHY_set_timing(mp, mem_timing[dev][0], mem_timing[dev][1],
+		mem_timing[dev][2]);
+}
+#endif
+
+static double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Read the next process entry "[start time] [path] [priority]" of the
+ * config into [ld_processes]. A path without any '/' names a program of
+ * input/proc, others are used as they are. Return 0 once the config has
+ * no more entries */
+static int read_process(void) {
+	struct ld_args * ld = &ld_processes;
+	double start = now_sec();
+	char * name = NULL;
+	char * end;
+	ssize_t len;
+	size_t need;
+
+	if (ld->nr_read >= num_processes) {
+		return 0;
+	}
+	do {
+		if ((len = getline(&ld->line, &ld->line_cap, ld->file)) < 0) {
+			return 0;
+		}
+		ld->bytes += len;
+		ld->start_time = strtoul(ld->line, &end, 10);
+	} while (end == ld->line && strspn(end, " \t\r\n") == len);
+
+	if (end != ld->line) {
+		name = strtok(end, " \t\r\n");
+	}
+	ld->prio = 0;
+#ifdef MLQ_SCHED
+	if (name != NULL) {
+		/* The priority indexes the ready queues */
+		char * prio = strtok(NULL, " \t\r\n");
+		if (prio != NULL) {
+			ld->prio = strtoul(prio, &end, 10);
+		}
+		if (prio == NULL || end == prio || *end != '\0' ||
+				ld->prio >= MAX_PRIO) {
+			name = NULL;
+		}
+	}
+#endif
+	if (name == NULL) {
+		printf("Bad process entry %lu of the config: %s\n",
+			ld->nr_read + 1, ld->line);
+		exit(1);
+	}
+	need = strlen(name) + sizeof("input/proc/");
+	if (need > ld->path_cap) {
+		ld->path = realloc(ld->path, need);
+		ld->path_cap = need;
+	}
+	snprintf(ld->path, need, "%s%s",
+		strchr(name, '/') ? "" : "input/proc/", name);
+	ld->nr_read++;
+	ld->parse_sec += now_sec() - start;
+	return 1;
+}
+
 static void * ld_routine(void * args) {
 #ifdef MM_PAGING
 	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
@@ -107,16 +410,16 @@ static void * ld_routine(void * args) {
 #else
 	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
-	int i = 0;
 	printf("ld_routine\n");
-	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
+	while (read_process()) {
+		while (current_time() < ld_processes.start_time) {
+			ld_publish(0);
+			idle_slot(timer_id, ld_processes.start_time);
+		}
+		struct pcb_t * proc = load(ld_processes.path);
 #ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
+		proc->prio = ld_processes.prio;
 #endif
-		while (current_time() < ld_processes.start_time[i]) {
-			next_slot(timer_id);
-		}
 #ifdef MM_PAGING
 		proc->mm = malloc(sizeof(struct mm_struct));
 		init_mm(proc->mm, proc);
@@ -125,19 +428,22 @@ static void * ld_routine(void * args) {
 		proc->active_mswp = active_mswp;
 #endif
 		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
+			ld_processes.path, proc->pid, ld_processes.prio);
+		atomic_fetch_add(&nr_live_procs, 1);
 		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
+		ld_publish(0);
 		next_slot(timer_id);
 	}
+	fclose(ld_processes.file);
+	free(ld_processes.line);
 	free(ld_processes.path);
-	free(ld_processes.start_time);
-	done = 1;
+	ld_publish(1);
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+static int parse_option(char * opt);
+
 static void read_config(const char * path) {
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
@@ -145,9 +451,6 @@ static void read_config(const char * path) {
 		exit(1);
 	}
 	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
-	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
-	ld_processes.start_time = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
 #ifdef MM_PAGING
 	int sit;
 #ifdef MM_FIXED_MEMSZ
@@ -173,36 +476,283 @@ static void read_config(const char * path) {
 #endif
 #endif
 
-#ifdef MLQ_SCHED
-	ld_processes.prio = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
-#endif
-	int i;
-	for (i = 0; i < num_processes; i++) {
-		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
-		ld_processes.path[i][0] = '\0';
-		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
-#ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
-#else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
+	/* Option lines, as on the command line */
+	int c;
+	while ((c = fgetc(file)) == '-') {
+		ungetc(c, file);
+		if (getline(&ld_processes.line, &ld_processes.line_cap, file) < 0) {
+			break;
+		}
+		ld_processes.line[strcspn(ld_processes.line, " \t\r\n")] = '\0';
+		/* Kept for the run, options may point into it */
+		if (parse_option(strdup(ld_processes.line)) < 0) {
+			printf("Bad option in configure file: %s\n",
+				ld_processes.line);
+			exit(1);
+		}
+	}
+	if (c != EOF) {
+		ungetc(c, file);
+	}
+
+	ld_processes.file = file;
+}
+
+/* Parse a startup option of the form --name=value.
+ * Return 0 if the option is applied, otherwise return -1 */
+static int parse_option(char * opt) {
+	char * val;
+	if (strncmp(opt, "--", 2) || (val = strchr(opt, '=')) == NULL) {
+		return -1;
+	}
+	*val++ = '\0';
+	opt += 2;
+	if (!strcmp(opt, "timer")) {
+		if (!strcmp(val, "condvar")) {
+			return set_timer_engine(TIMER_ENGINE_CONDVAR);
+		}else if (!strcmp(val, "barrier")) {
+			return set_timer_engine(TIMER_ENGINE_BARRIER);
+		}
+	}else if (!strcmp(opt, "sched")) {
+		if (!strcmp(val, "prio")) {
+			return set_sched_policy(SCHED_POLICY_PRIO);
+		}else if (!strcmp(val, "rr")) {
+			return set_sched_policy(SCHED_POLICY_RR);
+		}
+	}else if (!strcmp(opt, "fast-forward")) {
+		if (!strcmp(val, "on")) {
+			return set_timer_fast_forward(1);
+		}else if (!strcmp(val, "off")) {
+			return set_timer_fast_forward(0);
+		}
+	}else if (!strcmp(opt, "macro-slot")) {
+		if (!strcmp(val, "on")) {
+			macro_slot = 1;
+			return 0;
+		}else if (!strcmp(val, "off")) {
+			macro_slot = 0;
+			return 0;
+		}
+	}else if (!strcmp(opt, "sched-trace")) {
+		sched_trace_path = val;
+		return 0;
+	}else if (!strcmp(opt, "sched-verify")) {
+		sched_verify_path = val;
+		return 0;
+#ifdef MM_PAGING
+	}else if (!strcmp(opt, "pgrepl")) {
+		if (!strcmp(val, "fifo")) {
+			return pgrepl_set_policy(PGREPL_FIFO, NULL);
+		}else if (!strcmp(val, "clock")) {
+			return pgrepl_set_policy(PGREPL_CLOCK, NULL);
+		}else if (!strcmp(val, "lru")) {
+			return pgrepl_set_policy(PGREPL_LRU, NULL);
+		}else if (!strncmp(val, "opt:", 4)) {
+			return pgrepl_set_policy(PGREPL_OPT, val + 4);
+		}
+	}else if (!strcmp(opt, "pgtrace")) {
+		return pgrepl_set_trace(val);
+	}else if (!strcmp(opt, "swap-cost")) {
+		/* One latency for every device or one per device */
+		int sit = 0, slots;
+		char * end;
+		if (strchr(val, ',') == NULL) {
+			slots = strtol(val, &end, 10);
+			if (slots < 0 || end == val || *end != '\0') {
+				return -1;
+			}
+			for (sit = 1; sit <= PAGING_MAX_MMSWP; sit++) {
+				mem_timing[sit][0] = slots * MEMPHY_COST_UNIT;
+			}
+			return 0;
+		}
+		do {
+			slots = strtol(val, &end, 10);
+			if (sit == PAGING_MAX_MMSWP || slots < 0 || end == val) {
+				return -1;
+			}
+			mem_timing[++sit][0] = slots * MEMPHY_COST_UNIT;
+			val = end + 1;
+		} while (*end == ',');
+		return (*end == '\0') ? 0 : -1;
+	}else if (!strcmp(opt, "mem-file")) {
+		int dev;
+		char * path = strchr(val, ':');
+		if (path == NULL || path[1] == '\0') {
+			return -1;
+		}
+		*path++ = '\0';
+		if (!strcmp(val, "ram")) {
+			dev = 0;
+		}else if (sscanf(val, "swp%d", &dev) == 1 && dev >= 0 &&
+				dev < PAGING_MAX_MMSWP) {
+			dev++;
+		}else{
+			return -1;
+		}
+		mem_file[dev] = path;
+		return 0;
+	}else if (!strcmp(opt, "mem-timing")) {
+		int dev, lat, seek, xfer;
+		if (sscanf(val, "ram:%d:%d:%d", &lat, &seek, &xfer) == 3) {
+			dev = 0;
+		}else if (sscanf(val, "swp%d:%d:%d:%d", &dev, &lat, &seek,
+				&xfer) == 4 && dev >= 0 && dev < PAGING_MAX_MMSWP) {
+			dev++;
+		}else{
+			return -1;
+		}
+		if (lat < 0 || seek < 0 || xfer < 0) {
+			return -1;
+		}
+		mem_timing[dev][0] = lat;
+		mem_timing[dev][1] = seek;
+		mem_timing[dev][2] = xfer;
+		return 0;
+	}else if (!strcmp(opt, "swap-place")) {
+		if (!strcmp(val, "stripe")) {
+			return reclaim_set_swap_place(SWAP_PLACE_STRIPE);
+		}else if (!strcmp(val, "free")) {
+			return reclaim_set_swap_place(SWAP_PLACE_FREE);
+		}else if (!strcmp(val, "tier")) {
+			return reclaim_set_swap_place(SWAP_PLACE_TIER);
+		}
+	}else if (!strcmp(opt, "kswapd")) {
+		int low = 0, high = 0;
+		if (!strcmp(val, "off")) {
+			kswapd = 0;
+			return 0;
+		}else if (!strcmp(val, "on") ||
+				sscanf(val, "%d:%d", &low, &high) == 2) {
+			kswapd = 1;
+			return kswapd_set_watermarks(low, high);
+		}
+	}else if (!strcmp(opt, "page-size")) {
+		char * end;
+		long pagesz = strtol(val, &end, 10);
+		if (end == val || *end != '\0' || pagesz > PAGING_PAGESZ_MAX) {
+			return -1;
+		}
+		return paging_set_pagesz(pagesz);
+	}else if (!strcmp(opt, "huge-pages")) {
+		char * end;
+		long pgnum;
+		if (!strcmp(val, "off")) {
+			return paging_set_huge(0);
+		}else if (!strcmp(val, "on")) {
+			return paging_set_huge(PAGING_HUGE_DEFAULT_PGNUM);
+		}
+		pgnum = strtol(val, &end, 10);
+		if (end == val || *end != '\0' || pgnum > 64) {
+			return -1;
+		}
+		return paging_set_huge(pgnum);
+	}else if (!strcmp(opt, "tlb")) {
+		int entries, ways = 1;
+		if (!strcmp(val, "off")) {
+			return tlb_set_geometry(0, 1);
+		}else if (sscanf(val, "%dx%d", &entries, &ways) >= 1) {
+			return tlb_set_geometry(entries, ways);
+		}
 #endif
-		strcat(ld_processes.path[i], proc);
+	}else if (!strcmp(opt, "prog-cache")) {
+		if (!strcmp(val, "on")) {
+			set_loader_cache(1);
+			return 0;
+		}else if (!strcmp(val, "off")) {
+			set_loader_cache(0);
+			return 0;
+		}
+	}else if (!strcmp(opt, "runqueue")) {
+		if (!strcmp(val, "percpu")) {
+			return set_sched_rq_mode(SCHED_RQ_PERCPU);
+		}else if (!strcmp(val, "global")) {
+			return set_sched_rq_mode(SCHED_RQ_GLOBAL);
+		}
 	}
+	return -1;
+}
+
+static void usage(void) {
+	printf("Usage: os [options] [configure file]\n");
+	printf("A configure file or program without any '/' in its path is\n");
+	printf("looked up in input or input/proc respectively\n");
+	printf("Options:\n");
+	printf("  --timer=condvar|barrier  time slot synchronization engine\n");
+	printf("  --fast-forward=on|off    skip slots in which every device idles\n");
+	printf("  --macro-slot=on|off      run CALC batches without per-slot sync\n");
+	printf("  --sched-trace=FILE       write the schedule trace to FILE\n");
+	printf("  --sched-verify=FILE      compare the schedule trace with FILE\n");
+	printf("  --sched=prio|rr          MLQ level selection policy\n");
+	printf("  --runqueue=percpu|global per-CPU run queues or a shared one\n");
+	printf("  --prog-cache=on|off      share the code of identical programs\n");
+	printf("  --tlb=off|N[xWAYS]       per-CPU TLB of N entries (default %dx%d)\n",
+		TLB_DEFAULT_ENTRIES, TLB_DEFAULT_WAYS);
+	printf("  --page-size=N            page size in bytes, a power of two\n");
+	printf("                           from %d to %d (default %d)\n",
+		PAGING_PAGESZ_MIN, PAGING_PAGESZ_MAX, PAGING_PAGESZ_MIN);
+	printf("  --huge-pages=off|on|N    map ALLOCs of a huge page or more on\n");
+	printf("                           huge pages of N pages (on: %d) kept\n",
+		PAGING_HUGE_DEFAULT_PGNUM);
+	printf("                           in MEMRAM, one TLB entry each\n");
+	printf("  --pgrepl=fifo|clock|lru|opt:TRACE\n");
+	printf("                           page replacement policy, OPT looks\n");
+	printf("                           ahead in a trace from --pgtrace\n");
+	printf("  --pgtrace=FILE           record the page references to FILE\n");
+	printf("  --swap-cost=N[,N...]     slots to move a page to or from swap,\n");
+	printf("                           for all devices or device by device\n");
+	printf("  --mem-file=DEV:PATH|anon map the storage of DEV, ram or swp0..\n");
+	printf("                           swp%d, on a sparse file kept after the\n",
+		PAGING_MAX_MMSWP - 1);
+	printf("                           run or on lazily backed memory\n");
+	printf("  --mem-timing=DEV:LAT:SEEK:XFER\n");
+	printf("                           access latency, cost per KB of seek\n");
+	printf("                           and per KB transferred of DEV, ram or\n");
+	printf("                           swp0..swp%d, in thousandths of a slot\n",
+		PAGING_MAX_MMSWP - 1);
+	printf("  --swap-place=stripe|free|tier\n");
+	printf("                           spread evicted pages round-robin, on\n");
+	printf("                           the emptiest or on the fastest device\n");
+	printf("  --kswapd=off|on|LOW:HIGH page out ahead to keep LOW to HIGH\n");
+	printf("                           free frames (default MEMRAM/16 to /8)\n");
+	printf("Options may also be given on lines of their own right after\n");
+	printf("the memory sizes of the configure file\n");
 }
 
 int main(int argc, char * argv[]) {
-	/* Read config */
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
+	/* Read options and config */
+	if (argc < 2) {
+		usage();
 		return 1;
 	}
-	char path[100];
-	path[0] = '\0';
-	strcat(path, "input/");
-	strcat(path, argv[1]);
+	/* A config name without any '/' is looked up in input */
+	const char * cfg = argv[argc - 1];
+	char * path = malloc(strlen(cfg) + sizeof("input/"));
+	sprintf(path, "%s%s", strchr(cfg, '/') ? "" : "input/", cfg);
 	read_config(path);
+	free(path);
+
+	/* The command line has the last word over the config */
+	int a;
+	for (a = 1; a < argc - 1; a++) {
+		if (parse_option(argv[a]) < 0) {
+			usage();
+			return 1;
+		}
+	}
+
+	if (sched_trace_path != NULL) {
+		sched_trace_file = fopen(sched_trace_path,
+			(sched_verify_path != NULL) ? "w+" : "w");
+	}else if (sched_verify_path != NULL) {
+		sched_trace_file = tmpfile();
+	}
+	if ((sched_trace_path != NULL || sched_verify_path != NULL) &&
+			sched_trace_file == NULL) {
+		printf("Cannot open schedule trace file\n");
+		return 1;
+	}
+	ordered_arrivals = (sched_trace_file != NULL);
 
 	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args * args =
@@ -216,6 +766,14 @@ int main(int argc, char * argv[]) {
 		args[i].id = i;
 	}
 	struct timer_id_t * ld_event = attach_event();
+#ifdef MM_PAGING
+	struct kswapd_args kswapd_args;
+	pthread_t kswapd_thread;
+	atomic_init(&cpus_running, num_cpus);
+	if (kswapd) {
+		kswapd_args.timer_id = attach_event();
+	}
+#endif
 	start_timer();
 
 #ifdef MM_PAGING
@@ -227,12 +785,15 @@ int main(int argc, char * argv[]) {
 
 
 	/* Create MEM RAM */
-	init_memphy(&mram, memramsz, rdmflag);
+	init_memphy_dev(&mram, 0, memramsz, rdmflag);
 
         /* Create all MEM SWAP */ 
 	int sit;
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-	       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+	       init_memphy_dev(&mswp[sit], sit + 1, memswpsz[sit], rdmflag);
+	       /* Evicted pages are spread over all of them */
+	       reclaim_set_swap(sit, &mswp[sit]);
+	}
 
 	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
@@ -245,7 +806,7 @@ int main(int argc, char * argv[]) {
 
 
 	/* Init scheduler */
-	init_scheduler();
+	init_scheduler(num_cpus);
 
 	/* Run CPU and loader */
 #ifdef MM_PAGING
@@ -257,17 +818,58 @@ int main(int argc, char * argv[]) {
 		pthread_create(&cpu[i], NULL,
 			cpu_routine, (void*)&args[i]);
 	}
+#ifdef MM_PAGING
+	if (kswapd) {
+		kswapd_args.mram = &mram;
+		pthread_create(&kswapd_thread, NULL, kswapd_routine,
+			(void*)&kswapd_args);
+	}
+#endif
 
 	/* Wait for CPU and loader finishing */
 	for (i = 0; i < num_cpus; i++) {
 		pthread_join(cpu[i], NULL);
 	}
 	pthread_join(ld, NULL);
+#ifdef MM_PAGING
+	if (kswapd) {
+		pthread_join(kswapd_thread, NULL);
+	}
+#endif
 
 	/* Stop timer */
 	stop_timer();
 
-	return 0;
+	finish_scheduler();
+	finish_loader();
+#ifdef MM_PAGING
+	paging_report();
+	tlb_report();
+	pgrepl_report();
+	reclaim_report();
+	MEMPHY_report(&mram, "MEMRAM");
+
+	free_memphy(&mram);
+	for (sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+		free_memphy(&mswp[sit]);
+	}
+	free(mm_ld_args);
+#endif
+	printf("Config: %lu processes, %lu bytes parsed in %.3f ms"
+		" (%.0f processes/s)\n", ld_processes.nr_read,
+		ld_processes.bytes, ld_processes.parse_sec * 1e3,
+		ld_processes.parse_sec > 0 ?
+			ld_processes.nr_read / ld_processes.parse_sec : 0);
+
+	int status = 0;
+	if (sched_verify_path != NULL) {
+		status = verify_sched_trace();
+	}
+	if (sched_trace_file != NULL) {
+		fclose(sched_trace_file);
+	}
+
+	return status;
 
 }
 
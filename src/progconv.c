@@ -0,0 +1,29 @@
+/*
+ * Convert text programs to program images (see loader.h)
+ * Usage: progconv <program> <image> [<program> <image> ...]
+ */
+
+#include "loader.h"
+
+#include <stdio.h>
+
+int main(int argc, char * argv[]) {
+	int i;
+
+	if (argc < 3 || argc % 2 == 0) {
+		printf("Usage: %s <program> <image> [<program> <image> ...]\n",
+			argv[0]);
+		return 1;
+	}
+	for (i = 1; i < argc; i += 2) {
+		struct pcb_t * proc = load(argv[i]);
+		if (save_image(argv[i + 1], proc->priority, proc->code)) {
+			printf("Cannot write program image at '%s'\n",
+				argv[i + 1]);
+			return 1;
+		}
+		printf("%s -> %s (%u instructions)\n",
+			argv[i], argv[i + 1], proc->code->size);
+	}
+	return 0;
+}
@@ -2,23 +2,46 @@
 #include <stdlib.h>
 #include "queue.h"
 
+void init_queue(struct queue_t * q) {
+	q->proc = NULL;
+	q->head = 0;
+	q->size = 0;
+	q->capacity = 0;
+}
+
 int empty(struct queue_t * q) {
 	return (q->size == 0);
 }
 
+/* Double the capacity of [q], unwrapping its content to the front */
+static void grow_queue(struct queue_t * q) {
+	int capacity = q->capacity ? q->capacity * 2 : QUEUE_INIT_SIZE;
+	struct pcb_t ** proc = malloc(capacity * sizeof(struct pcb_t *));
+	int i;
+
+	if (proc == NULL) {
+		printf("Cannot grow queue to %d processes\n", capacity);
+		exit(1);
+	}
+	for (i = 0; i < q->size; i++)
+		proc[i] = q->proc[(q->head + i) & (q->capacity - 1)];
+	free(q->proc);
+	q->proc = proc;
+	q->head = 0;
+	q->capacity = capacity;
+}
+
 void enqueue(struct queue_t * q, struct pcb_t * proc) {
-        /* TODO: put a new process to queue [q] */
-        if(q->size == MAX_QUEUE_SIZE) return;
-        q->proc[q->size++] = proc; 
+        if (q->size == q->capacity)
+                grow_queue(q);
+        q->proc[(q->head + q->size) & (q->capacity - 1)] = proc;
+        q->size++;
 }
 
 struct pcb_t * dequeue(struct queue_t * q) {
-        /* TODO: return a pcb whose prioprity is the highest
-         * in the queue [q] and remember to remove it from q
-         * */
-        if(empty(q)) return NULL;
-        struct pcb_t* result = q->proc[0];
-        for(int i=0; i<q->size-1; i++) q->proc[i] = q->proc[i+1];
+        if (empty(q)) return NULL;
+        struct pcb_t * result = q->proc[q->head];
+        q->head = (q->head + 1) & (q->capacity - 1);
         q->size--;
 	return result;
 }
@@ -1,95 +1,271 @@
-
 #include "queue.h"
 #include "sched.h"
 #include <pthread.h>
+#include <errno.h>
+#include <stdatomic.h>
 
 #include <stdlib.h>
 #include <stdio.h>
 static struct queue_t ready_queue;
 static struct queue_t run_queue;
 static pthread_mutex_t queue_lock;
-static int queue_iterator = 0;
 
 #ifdef MLQ_SCHED
-static struct queue_t mlq_ready_queue[MAX_PRIO];
+/* One bit per non-empty level of [mlq_ready_queue] and one bit per
+ * non-zero word of [mlq_bitmap] in [mlq_summary], so the next level to
+ * serve is found with two find-first-set operations */
+#define MLQ_WORD_BITS	64
+#define MLQ_WORDS	((MAX_PRIO + MLQ_WORD_BITS - 1) / MLQ_WORD_BITS)
+
+/* MLQ run queue, there is one per CPU or a single shared one */
+struct mlq_rq_t {
+	pthread_mutex_t lock;
+	struct queue_t mlq_ready_queue[MAX_PRIO];
+	uint64_t mlq_bitmap[MLQ_WORDS];
+	uint64_t mlq_summary;
+	int queue_iterator;
+	atomic_int nr_ready;	// Read without the lock to pick a victim
+};
+
+/* Dispatch counters, each CPU only updates its own entry */
+struct sched_stat_t {
+	unsigned long local;	// Processes taken from the own run queue
+	unsigned long steal;	// Processes stolen from a sibling
+	unsigned long contended;// Run queue lock found busy
+};
+
+static struct mlq_rq_t * rqs;
+static int nr_rqs;
+static struct sched_stat_t * stats;
+static int nr_cpus;
+static atomic_uint add_iterator;
+
+static enum sched_policy_t sched_policy = SCHED_POLICY_PRIO;
+static enum sched_rq_mode_t sched_rq_mode = SCHED_RQ_PERCPU;
+#endif
+
+int set_sched_policy(enum sched_policy_t policy) {
+#ifdef MLQ_SCHED
+	sched_policy = policy;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+int set_sched_rq_mode(enum sched_rq_mode_t mode) {
+#ifdef MLQ_SCHED
+	sched_rq_mode = mode;
+	return 0;
+#else
+	return -1;
 #endif
+}
 
 int queue_empty(void) {
 #ifdef MLQ_SCHED
-	unsigned long prio;
-	for (prio = 0; prio < MAX_PRIO; prio++)
-		if(!empty(&mlq_ready_queue[prio])) 
-			return -1;
+	int i;
+	for (i = 0; i < nr_rqs; i++)
+		if (atomic_load(&rqs[i].nr_ready) != 0)
+			return 0;
 #endif
 	return (empty(&ready_queue) && empty(&run_queue));
 }
 
-void init_scheduler(void) {
+void init_scheduler(int ncpus) {
 #ifdef MLQ_SCHED
-    int i ;
+	int i, prio;
 
-	for (i = 0; i < MAX_PRIO; i++)
-		mlq_ready_queue[i].size = 0;
+	nr_cpus = ncpus;
+	nr_rqs = (sched_rq_mode == SCHED_RQ_PERCPU) ? ncpus : 1;
+	rqs = malloc(nr_rqs * sizeof(struct mlq_rq_t));
+	stats = calloc(ncpus, sizeof(struct sched_stat_t));
+	for (i = 0; i < nr_rqs; i++) {
+		struct mlq_rq_t * rq = &rqs[i];
+		pthread_mutex_init(&rq->lock, NULL);
+		for (prio = 0; prio < MAX_PRIO; prio++)
+			init_queue(&rq->mlq_ready_queue[prio]);
+		for (prio = 0; prio < MLQ_WORDS; prio++)
+			rq->mlq_bitmap[prio] = 0;
+		rq->mlq_summary = 0;
+		rq->queue_iterator = 0;
+		atomic_init(&rq->nr_ready, 0);
+	}
+	atomic_init(&add_iterator, 0);
 #endif
-	ready_queue.size = 0;
-	run_queue.size = 0;
+	init_queue(&ready_queue);
+	init_queue(&run_queue);
 	pthread_mutex_init(&queue_lock, NULL);
 }
 
 #ifdef MLQ_SCHED
-/* 
+void finish_scheduler(void) {
+	struct sched_stat_t total = { 0, 0, 0 };
+	int i, prio;
+
+	printf("Scheduler statistics (%s):\n",
+		(nr_rqs > 1) ? "per-CPU run queues" : "global run queue");
+	for (i = 0; i < nr_cpus; i++) {
+		printf("\tCPU %d: local %lu steal %lu contended %lu\n", i,
+			stats[i].local, stats[i].steal, stats[i].contended);
+		total.local += stats[i].local;
+		total.steal += stats[i].steal;
+		total.contended += stats[i].contended;
+	}
+	printf("\tTotal: local %lu steal %lu contended %lu\n",
+		total.local, total.steal, total.contended);
+
+	for (i = 0; i < nr_rqs; i++) {
+		for (prio = 0; prio < MAX_PRIO; prio++)
+			free(rqs[i].mlq_ready_queue[prio].proc);
+		pthread_mutex_destroy(&rqs[i].lock);
+	}
+	free(rqs);
+	free(stats);
+}
+
+/* Lock [rq] on behalf of [cpu], counting the attempts that have to
+ * wait. The loader passes a negative [cpu] and is not accounted */
+static void rq_lock(struct mlq_rq_t * rq, int cpu) {
+	if (cpu < 0) {
+		pthread_mutex_lock(&rq->lock);
+	}else if (pthread_mutex_trylock(&rq->lock) == EBUSY) {
+		stats[cpu].contended++;
+		pthread_mutex_lock(&rq->lock);
+	}
+}
+
+static void mlq_mark(struct mlq_rq_t * rq, int prio) {
+	rq->mlq_bitmap[prio / MLQ_WORD_BITS] |= 1ULL << (prio % MLQ_WORD_BITS);
+	rq->mlq_summary |= 1ULL << (prio / MLQ_WORD_BITS);
+}
+
+static void mlq_unmark(struct mlq_rq_t * rq, int prio) {
+	int w = prio / MLQ_WORD_BITS;
+	rq->mlq_bitmap[w] &= ~(1ULL << (prio % MLQ_WORD_BITS));
+	if (rq->mlq_bitmap[w] == 0)
+		rq->mlq_summary &= ~(1ULL << w);
+}
+
+/* Return the first non-empty level at or after [from], -1 if none */
+static int mlq_find_from(struct mlq_rq_t * rq, int from) {
+	int w = from / MLQ_WORD_BITS;
+	uint64_t bits;
+
+	if (from >= MAX_PRIO)
+		return -1;
+	bits = rq->mlq_bitmap[w] & (~0ULL << (from % MLQ_WORD_BITS));
+	if (bits)
+		return w * MLQ_WORD_BITS + __builtin_ctzll(bits);
+	bits = rq->mlq_summary & (~0ULL << w << 1);
+	if (!bits)
+		return -1;
+	w = __builtin_ctzll(bits);
+	return w * MLQ_WORD_BITS + __builtin_ctzll(rq->mlq_bitmap[w]);
+}
+
+/*
  *  Stateful design for routine calling
  *  based on the priority and our MLQ policy
  *  We implement stateful here using transition technique
  *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
+ *  The caller must hold [rq->lock]
  */
-struct pcb_t * get_mlq_proc(int* timeslot) {
+static struct pcb_t * mlq_pick(struct mlq_rq_t * rq, int * timeslot) {
 	struct pcb_t * proc = NULL;
-	/*TODO: get a process from PRIORITY [ready_queue].
-	 * Remember to use lock to protect the queue.
-	 * */
+	int prio;
 
-	pthread_mutex_lock(&queue_lock);
-	while(1) {
-		if(!empty(&mlq_ready_queue[queue_iterator])) {
-			proc = dequeue(&mlq_ready_queue[queue_iterator]);
-			*timeslot = MAX_PRIO - proc->prio;
-			queue_iterator = (queue_iterator + 1) % MAX_PRIO;
-			pthread_mutex_unlock(&queue_lock);	
-			return proc;
+	if (sched_policy == SCHED_POLICY_RR) {
+		/* Resume the walk over the levels where the previous call
+		 * stopped. A walk passing the last level finds nothing and
+		 * restarts from level 0 on the next call */
+		prio = mlq_find_from(rq, rq->queue_iterator);
+		rq->queue_iterator = (prio < 0) ? 0 : (prio + 1) % MAX_PRIO;
+	}else{
+		prio = mlq_find_from(rq, 0);
+	}
+	if (prio >= 0) {
+		proc = dequeue(&rq->mlq_ready_queue[prio]);
+		if (empty(&rq->mlq_ready_queue[prio]))
+			mlq_unmark(rq, prio);
+		atomic_fetch_sub(&rq->nr_ready, 1);
+		*timeslot = MAX_PRIO - proc->prio;
+	}
+	return proc;
+}
+
+static void mlq_push(struct mlq_rq_t * rq, int cpu, struct pcb_t * proc) {
+	rq_lock(rq, cpu);
+	enqueue(&rq->mlq_ready_queue[proc->prio], proc);
+	mlq_mark(rq, proc->prio);
+	atomic_fetch_add(&rq->nr_ready, 1);
+	pthread_mutex_unlock(&rq->lock);
+}
+
+/* Take a process from the sibling run queue holding the most ones */
+static struct pcb_t * mlq_steal(int cpu, int * timeslot) {
+	struct pcb_t * proc = NULL;
+	int i, victim = -1, busiest = 0;
+
+	for (i = 0; i < nr_rqs; i++) {
+		int nr = atomic_load_explicit(&rqs[i].nr_ready,
+			memory_order_relaxed);
+		if (i != cpu && nr > busiest) {
+			busiest = nr;
+			victim = i;
 		}
-		queue_iterator = (queue_iterator + 1) % MAX_PRIO;
-		if(queue_iterator == 0) break;
 	}
-	pthread_mutex_unlock(&queue_lock);	
-	return proc;	
+	if (victim < 0)
+		return NULL;
+
+	rq_lock(&rqs[victim], cpu);
+	proc = mlq_pick(&rqs[victim], timeslot);
+	pthread_mutex_unlock(&rqs[victim].lock);
+	if (proc != NULL)
+		stats[cpu].steal++;
+	return proc;
 }
 
-void put_mlq_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);
+struct pcb_t * get_mlq_proc(int cpu, int * timeslot) {
+	struct mlq_rq_t * rq = &rqs[cpu % nr_rqs];
+	struct pcb_t * proc;
+
+	rq_lock(rq, cpu);
+	proc = mlq_pick(rq, timeslot);
+	pthread_mutex_unlock(&rq->lock);
+	if (proc != NULL) {
+		stats[cpu].local++;
+		return proc;
+	}
+	return (nr_rqs > 1) ? mlq_steal(cpu, timeslot) : NULL;
+}
+
+void put_mlq_proc(int cpu, struct pcb_t * proc) {
+	mlq_push(&rqs[cpu % nr_rqs], cpu, proc);
 }
 
 void add_mlq_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);	
+	/* New processes are spread over the run queues round-robin */
+	unsigned int rq = atomic_fetch_add(&add_iterator, 1) % nr_rqs;
+	mlq_push(&rqs[rq], -1, proc);
 }
 
-struct pcb_t * get_proc(int* timeslot) {
-	return get_mlq_proc(timeslot);
+struct pcb_t * get_proc(int cpu, int * timeslot) {
+	return get_mlq_proc(cpu, timeslot);
 }
 
-void put_proc(struct pcb_t * proc) {
-	return put_mlq_proc(proc);
+void put_proc(int cpu, struct pcb_t * proc) {
+	return put_mlq_proc(cpu, proc);
 }
 
 void add_proc(struct pcb_t * proc) {
 	return add_mlq_proc(proc);
 }
 #else
-struct pcb_t * get_proc(void) {
+void finish_scheduler(void) {
+}
+
+struct pcb_t * get_proc(int cpu, int * timeslot) {
 	struct pcb_t * proc = NULL;
 	/*TODO: get a process from [ready_queue].
 	 * Remember to use lock to protect the queue.
@@ -97,7 +273,7 @@ struct pcb_t * get_proc(void) {
 	return proc;
 }
 
-void put_proc(struct pcb_t * proc) {
+void put_proc(int cpu, struct pcb_t * proc) {
 	pthread_mutex_lock(&queue_lock);
 	enqueue(&run_queue, proc);
 	pthread_mutex_unlock(&queue_lock);
@@ -106,7 +282,7 @@ void put_proc(struct pcb_t * proc) {
 void add_proc(struct pcb_t * proc) {
 	pthread_mutex_lock(&queue_lock);
 	enqueue(&ready_queue, proc);
-	pthread_mutex_unlock(&queue_lock);	
+	pthread_mutex_unlock(&queue_lock);
 }
 #endif
 
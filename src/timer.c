@@ -2,6 +2,14 @@
 #include "timer.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 static pthread_t _timer;
 
@@ -17,6 +25,153 @@ static uint64_t _time;
 static int timer_started = 0;
 static int timer_stop = 0;
 
+static enum timer_engine_t timer_engine = TIMER_ENGINE_CONDVAR;
+static int timer_fast_forward = 0;
+
+/* Number of polls on a barrier word before falling back to sleep,
+ * spinning only pays off when devices run on distinct host CPUs */
+#define BARRIER_SPIN	128
+static int barrier_spin = 0;
+
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax()	__builtin_ia32_pause()
+#else
+#define cpu_relax()	do { } while (0)
+#endif
+
+/* State of the sense-reversing barrier. [bar_pending] counts devices
+ * which have not finished the current slot yet, [bar_alive] counts
+ * devices which are not detached. The timer thread is the master of
+ * the barrier: once [bar_pending] drops to zero it advances the time,
+ * re-arms [bar_pending] and flips [bar_sense] to release all devices
+ * at once. */
+static atomic_int bar_pending;
+static atomic_int bar_alive;
+static atomic_int bar_sense;
+/* Devices skipping slots, they are left out of [bar_pending] until
+ * the time reaches their [resume_at] */
+static atomic_int bar_parked;
+
+static void futex_wait(atomic_int * addr, int val) {
+#ifdef __linux__
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+	sched_yield();
+#endif
+}
+
+static void futex_wake(atomic_int * addr, int nr) {
+#ifdef __linux__
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, nr, NULL, NULL, 0);
+#endif
+}
+
+/* Spin for a while then sleep until [addr] no longer holds [val] */
+static void barrier_wait_while(atomic_int * addr, int val) {
+	int spin;
+	for (spin = 0; spin < barrier_spin; spin++) {
+		if (atomic_load_explicit(addr, memory_order_acquire) != val) {
+			return;
+		}
+		cpu_relax();
+	}
+	while (atomic_load_explicit(addr, memory_order_acquire) == val) {
+		futex_wait(addr, val);
+	}
+}
+
+/* A device reaches the end of its slot (or leaves for good) */
+static void barrier_arrive(void) {
+	if (atomic_fetch_sub_explicit(&bar_pending, 1,
+			memory_order_acq_rel) == 1) {
+		futex_wake(&bar_pending, 1);
+	}
+}
+
+/* Return the earliest time some device has work to do if all devices
+ * idle, 0 otherwise. Must be called while every device waits for the
+ * next slot */
+static uint64_t idle_horizon(void) {
+	uint64_t wake = TIMER_NEVER;
+	struct timer_id_container_t * temp;
+	for (temp = dev_list; temp != NULL; temp = temp->next) {
+		if (temp->id.fsh) {
+			continue;
+		}
+		if (temp->id.idle_until == 0) {
+			return 0;
+		}
+		if (temp->id.idle_until < wake) {
+			wake = temp->id.idle_until;
+		}
+	}
+	return (wake == TIMER_NEVER) ? 0 : wake;
+}
+
+/* Move to the next slot, jumping over the slots in which every device
+ * would just idle. Their headers are still printed so the trace is the
+ * same as stepping through them */
+static void advance_time(void) {
+	uint64_t wake = timer_fast_forward ? idle_horizon() : 0;
+	_time++;
+	while (_time < wake) {
+		printf("Time slot %3lu\n", current_time());
+		_time++;
+	}
+}
+
+static void * barrier_timer_routine(void * args) {
+	while (!timer_stop) {
+		printf("Time slot %3lu\n", current_time());
+		/* Wait for all devices have done the job in current
+		 * time slot */
+		int pending;
+		while ((pending = atomic_load_explicit(&bar_pending,
+				memory_order_acquire)) != 0) {
+			barrier_wait_while(&bar_pending, pending);
+		}
+
+		/* Increase the time slot */
+		advance_time();
+
+		/* Re-arm the barrier and let devices continue their job */
+		int alive = atomic_load_explicit(&bar_alive,
+			memory_order_acquire);
+		int parked = atomic_load_explicit(&bar_parked,
+			memory_order_acquire);
+		int attending = alive;
+		struct timer_id_container_t * temp;
+		if (parked) {
+			for (temp = dev_list; temp != NULL; temp = temp->next) {
+				if (atomic_load(&temp->id.parked) &&
+						temp->id.resume_at > _time) {
+					attending--;
+				}
+			}
+		}
+		atomic_store_explicit(&bar_pending, attending,
+			memory_order_relaxed);
+		atomic_fetch_xor_explicit(&bar_sense, 1, memory_order_release);
+		futex_wake(&bar_sense, INT_MAX);
+		if (parked) {
+			/* Devices whose skipped slots are over join again */
+			for (temp = dev_list; temp != NULL; temp = temp->next) {
+				if (atomic_load(&temp->id.parked) &&
+						temp->id.resume_at <= _time) {
+					atomic_fetch_sub(&bar_parked, 1);
+					atomic_store_explicit(&temp->id.parked,
+						0, memory_order_release);
+					futex_wake(&temp->id.parked, 1);
+				}
+			}
+		}
+		if (alive == 0) {
+			break;
+		}
+	}
+	pthread_exit(args);
+}
+
 
 static void * timer_routine(void * args) {
 	while (!timer_stop) {
@@ -42,10 +197,14 @@ static void * timer_routine(void * args) {
 		}
 
 		/* Increase the time slot */
-		_time++;
+		advance_time();
 		
-		/* Let devices continue their job */
+		/* Let devices continue their job, except the ones still
+		 * skipping slots */
 		for (temp = dev_list; temp != NULL; temp = temp->next) {
+			if (temp->id.resume_at > _time) {
+				continue;
+			}
 			pthread_mutex_lock(&temp->id.timer_lock);
 			temp->id.done = 0;
 			pthread_cond_signal(&temp->id.timer_cond);
@@ -58,9 +217,47 @@ static void * timer_routine(void * args) {
 	pthread_exit(args);
 }
 
+void idle_slot(struct timer_id_t * timer_id, uint64_t wake_time) {
+	timer_id->idle_until = wake_time;
+	next_slot(timer_id);
+	timer_id->idle_until = 0;
+}
+
 void next_slot(struct timer_id_t * timer_id) {
+	next_slots(timer_id, 1);
+}
+
+void next_slots(struct timer_id_t * timer_id, uint32_t n) {
+	uint64_t idle_until = timer_id->idle_until;
+	if (n > 1) {
+		/* The device has its own work up to the resume time */
+		timer_id->idle_until = current_time() + n;
+	}
+
+	if (timer_engine == TIMER_ENGINE_BARRIER) {
+		if (n > 1) {
+			/* Leave the barrier until the resume time, then take
+			 * the sense the timer published meanwhile */
+			timer_id->resume_at = current_time() + n;
+			atomic_store(&timer_id->parked, 1);
+			atomic_fetch_add(&bar_parked, 1);
+			barrier_arrive();
+			barrier_wait_while(&timer_id->parked, 1);
+			timer_id->sense = atomic_load(&bar_sense);
+		}else{
+			/* Arrive with the flipped local sense and wait for
+			 * the timer to publish the same sense */
+			timer_id->sense = !timer_id->sense;
+			barrier_arrive();
+			barrier_wait_while(&bar_sense, !timer_id->sense);
+		}
+		timer_id->idle_until = idle_until;
+		return;
+	}
+
 	/* Tell to timer that we have done our job in current slot */
 	pthread_mutex_lock(&timer_id->event_lock);
+	timer_id->resume_at = current_time() + n;
 	timer_id->done = 1;
 	pthread_cond_signal(&timer_id->event_cond);
 	pthread_mutex_unlock(&timer_id->event_lock);
@@ -74,18 +271,48 @@ void next_slot(struct timer_id_t * timer_id) {
 		);
 	}
 	pthread_mutex_unlock(&timer_id->timer_lock);
+	timer_id->idle_until = idle_until;
 }
 
 uint64_t current_time() {
 	return _time;
 }
 
+int set_timer_engine(enum timer_engine_t engine) {
+	if (timer_started) {
+		return -1;
+	}
+	timer_engine = engine;
+	return 0;
+}
+
+int set_timer_fast_forward(int enable) {
+	if (timer_started) {
+		return -1;
+	}
+	timer_fast_forward = enable;
+	return 0;
+}
+
 void start_timer() {
 	timer_started = 1;
-	pthread_create(&_timer, NULL, timer_routine, NULL);
+	if (timer_engine == TIMER_ENGINE_BARRIER) {
+		barrier_spin = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ?
+			BARRIER_SPIN : 0;
+		atomic_store(&bar_pending, atomic_load(&bar_alive));
+		pthread_create(&_timer, NULL, barrier_timer_routine, NULL);
+	}else{
+		pthread_create(&_timer, NULL, timer_routine, NULL);
+	}
 }
 
 void detach_event(struct timer_id_t * event) {
+	if (timer_engine == TIMER_ENGINE_BARRIER) {
+		event->fsh = 1;
+		atomic_fetch_sub_explicit(&bar_alive, 1, memory_order_release);
+		barrier_arrive();
+		return;
+	}
 	pthread_mutex_lock(&event->event_lock);
 	event->fsh = 1;
 	pthread_cond_signal(&event->event_cond);
@@ -102,6 +329,10 @@ struct timer_id_t * attach_event() {
 			);
 		container->id.done = 0;
 		container->id.fsh = 0;
+		container->id.idle_until = 0;
+		container->id.resume_at = 0;
+		atomic_init(&container->id.parked, 0);
+		container->id.sense = atomic_load(&bar_sense);
 		pthread_cond_init(&container->id.event_cond, NULL);
 		pthread_mutex_init(&container->id.event_lock, NULL);
 		pthread_cond_init(&container->id.timer_cond, NULL);
@@ -113,6 +344,7 @@ struct timer_id_t * attach_event() {
 			container->next = dev_list;
 			dev_list = container;
 		}
+		atomic_fetch_add(&bar_alive, 1);
 		return &(container->id);
 	}
 }
@@ -129,6 +361,13 @@ void stop_timer() {
 		pthread_mutex_destroy(&temp->id.timer_lock);
 		free(temp);
 	}
+	/* Leave the timer ready to be started again */
+	atomic_store(&bar_alive, 0);
+	atomic_store(&bar_pending, 0);
+	atomic_store(&bar_parked, 0);
+	timer_started = 0;
+	timer_stop = 0;
+	_time = 0;
 }
 
 